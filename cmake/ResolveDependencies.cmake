@@ -27,11 +27,12 @@ macro(resolve_dependencies)
     else()
         pkg_check_modules(NCURSES REQUIRED ncurses form menu panel)
     endif()
-    pkg_check_modules(ICU REQUIRED icu-uc)
+    pkg_check_modules(ICU REQUIRED icu-uc icu-i18n)
     if(USE_GLOG)
         pkg_check_modules(GLOG REQUIRED libglog)
     endif()
     pkg_check_modules(NETTLE REQUIRED nettle)
+    find_package(Threads REQUIRED)
     add_compile_definitions($<$<BOOL:${GLOG_FOUND}>:HAVE_GLOG>)
 endmacro()
 
@@ -1,6 +1,20 @@
 /* Copyright 2023 Ian Boisvert */
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+
 #include "AccountDb.h"
 #include "Filesystem.h"
+#include "Parallel.h"
+
+/** Minimum number of records converted in parallel */
+static constexpr size_t MIN_PARALLEL_CONVERT_SIZE = 4096;
+/** Number of records converted between calls to the progress callback */
+static constexpr size_t PROGRESS_BATCH_SIZE = 256;
 
 /** Check if file at DbPathname() exists. */
 bool AccountDb::Exists() const
@@ -8,50 +22,418 @@ bool AccountDb::Exists() const
     return fs::Exists(db_pathname_);
 }
 
-bool AccountDb::ReadDb(int *rc)
+/**
+ * Convert the records in `nthreads` chunks on separate threads.
+ * Each thread writes only the elements of its own chunk and reports
+ * progress after every `PROGRESS_BATCH_SIZE` records. All threads stop
+ * before their next batch once `progress` returns `false`.
+ */
+bool AccountDb::ConvertRecords(const PwsDbRecord *records, unsigned nthreads, 
+    std::vector<AccountRecord> &converted, const ProgressCallback &progress)
+{
+    std::vector<const PwsDbRecord *> precs;
+    for (const PwsDbRecord *prec = records; prec; prec = prec->next)
+    {
+        precs.push_back(prec);
+    }
+    const size_t len = precs.size();
+    converted.clear();
+    converted.resize(len);
+
+    std::atomic<bool> stopped{false};
+    ParallelFor(len, nthreads, MIN_PARALLEL_CONVERT_SIZE, [&precs, &converted, &progress, &stopped](size_t begin, size_t end) {
+        for (size_t batch = begin; batch < end && !stopped; batch += PROGRESS_BATCH_SIZE)
+        {
+            size_t batch_end = std::min(end, batch + PROGRESS_BATCH_SIZE);
+            for (size_t j = batch; j < batch_end; ++j)
+            {
+                converted[j] = AccountRecord::FromPwsDbRecord(precs[j]);
+            }
+            if (progress && !progress(batch_end - batch))
+            {
+                stopped = true;
+            }
+        }
+    });
+    if (stopped)
+    {
+        converted.clear();
+        return false;
+    }
+    return true;
+}
+
+bool AccountDb::ReadPwsafeRecords(const std::string &db_pathname, const std::string &password, 
+    PwsDbRecord **records, std::vector<AccountRecord> &converted, uint64_t &db_hash, 
+    int *rc, const ProgressCallback &progress, unsigned nthreads)
+{
+    *records = nullptr;
+    converted.clear();
+    db_hash = 0;
+    int read_rc = RC_FAILURE;
+    bool status = pws_db_read(db_pathname.c_str(), password.c_str(), records, &read_rc);
+    if (!status)
+    {
+        // An incorrect password is detected before the records are decrypted,
+        // any other error reading an existing, readable file means the file is not valid
+        if (read_rc != RC_ERR_INCORRECT_PASSWORD && read_rc != RC_ERR_INVALID_ARG)
+        {
+            if (!fs::Exists(db_pathname))
+            {
+                read_rc = RC_ERR_FILE_DOESNT_EXIST;
+            }
+            else if (access(db_pathname.c_str(), R_OK) != 0)
+            {
+                read_rc = RC_ERR_CANT_OPEN_FILE;
+            }
+            else
+            {
+                read_rc = RC_ERR_CORRUPT_DB;
+            }
+        }
+        SetResultCode(rc, read_rc);
+    }
+    else
+    {
+        if (ConvertRecords(*records, nthreads, converted, progress))
+        {
+            // Hashed here so the first change written to the journal does not read the file
+            std::error_code ec;
+            db_hash = fs::HashFile(db_pathname, ec);
+            if (ec) db_hash = 0;
+            SetResultCode(rc, RC_SUCCESS);
+        }
+        else
+        {
+            pws_free_db_records(*records);
+            *records = nullptr;
+            SetResultCode(rc, RC_USER_CANCEL);
+            status = false;
+        }
+    }
+    return status;
+}
+
+void AccountDb::LoadRecords(PwsDbRecord *records, std::vector<AccountRecord> &&converted, uint64_t db_hash)
+{
+    db_hash_ = db_hash;
+    db_hash_pathname_ = db_pathname_;
+
+    std::unique_ptr<PwsDbRecord, decltype(&pws_free_db_records)> precords{records, pws_free_db_records};
+
+    records_.Reserve(records_.size() + converted.size());
+
+    // Bulk load, sort once after all records are read
+    for (AccountRecord &rec : converted)
+    {
+        records_.Append(std::move(rec));
+    }
+    converted.clear();
+    records_.SortRecords();
+
+    CachePwsafeRecords(precords.release());
+}
+
+bool AccountDb::ReadDb(int *rc, unsigned nthreads)
 {
     PwsDbRecord *records;
-    const char *pn = db_pathname_.c_str(), *pw = password_.c_str();
-    bool status = pws_db_read(pn, pw, &records, rc);
+    std::vector<AccountRecord> converted;
+    uint64_t db_hash;
+    bool status = ReadPwsafeRecords(db_pathname_, password_, &records, converted, db_hash, rc, nullptr, nthreads);
     if (status)
     {
-        std::unique_ptr<PwsDbRecord, decltype(&pws_free_db_records)> precords{records, pws_free_db_records};
+        LoadRecords(records, std::move(converted), db_hash);
+    }
+    return status;
+}
 
-        PwsDbRecord *prec = records;
-        while (prec)
+/** 
+ * Returns `true` if converting the record read from the database to an
+ * `AccountRecord` and back would produce the same fields
+ */
+static bool IsConvertible(const PwsDbRecord *prec)
+{
+    const auto &types = AccountRecord::FIELD_TYPES;
+    for (const PwsDbField *pfield = prec->fields; pfield; pfield = pfield->next)
+    {
+        if (!pfield->value || !*pfield->value 
+            || std::find(types.begin(), types.end(), pfield->type) == types.end())
         {
-            records_.Save(AccountRecord::FromPwsDbRecord(prec));
-            prec = prec->next;
+            return false;
         }
     }
-    return status;
+    return pws_rec_get_field(prec, FT_UUID) != nullptr;
 }
 
-PwsDbRecord *AccountDb::ConvertToPwsafeRecords()
+void AccountDb::UpdatePwsafeRecordsCache()
 {
-    PwsDbRecord *phead = nullptr;
+    if (pws_records_seq_ < records_.CleanSeq())
+    {
+        // Changes since the cache was updated are not known
+        pws_records_.clear();
+    }
+    else
+    {
+        // Drop cached records that were updated or deleted
+        for (const auto &[uuid, seq] : records_.Modified())
+        {
+            if (seq > pws_records_seq_) pws_records_.erase(uuid);
+        }
+    }
+    pws_records_seq_ = records_.ChangeSeq();
+}
+
+void AccountDb::CachePwsafeRecords(PwsDbRecord *records)
+{
+    UpdatePwsafeRecordsCache();
+    while (records)
+    {
+        PwsDbRecordPtr prec{records};
+        records = records->next;
+        prec->next = nullptr;
+        if (IsConvertible(prec.get()))
+        {
+            pws_records_[Uuid::FromString(pws_rec_get_field(prec.get(), FT_UUID))] = std::move(prec);
+        }
+    }
+}
+
+/**
+ * Records that are not in the cache are converted in `nthreads` chunks
+ * on separate threads, then all records are linked in sort order.
+ */
+PwsDbRecord *AccountDb::ConvertToPwsafeRecords(unsigned nthreads)
+{
+    UpdatePwsafeRecordsCache();
+
+    // References to elements of an unordered_map remain valid when it grows
+    std::vector<std::pair<const AccountRecord *, PwsDbRecordPtr *>> uncached;
+    std::vector<PwsDbRecordPtr *> cached;
+    cached.reserve(records_.size());
     for (const AccountRecord &ar : records_)
     {
-        PwsDbRecord *prec = ar.ToPwsDbRecord(phead);
+        PwsDbRecordPtr &prec = pws_records_[Uuid::FromString(ar.GetField(FT_UUID))];
         if (!prec)
         {
-            pws_free_db_records(phead);
-            phead = nullptr;
-            break;
+            uncached.emplace_back(&ar, &prec);
         }
-        phead = prec;
+        cached.push_back(&prec);
+    }
+
+    ParallelFor(uncached.size(), nthreads, MIN_PARALLEL_CONVERT_SIZE, [&uncached](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            uncached[i].second->reset(uncached[i].first->ToPwsDbRecord(nullptr));
+        }
+    });
+
+    PwsDbRecord *phead = nullptr;
+    for (PwsDbRecordPtr *prec : cached)
+    {
+        if (!*prec)
+        {
+            pws_records_.clear();
+            pws_records_seq_ = 0;
+            return nullptr;
+        }
+        (*prec)->next = phead;
+        phead = prec->get();
     }
     return phead;
 }
 
-bool AccountDb::WriteDb(int *rc)
+/** Flush the file or directory at `pathname` to storage */
+static bool Sync(const std::string &pathname, int flags)
 {
+    int fd = open(pathname.c_str(), flags);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool status = fsync(fd) == 0;
+    return close(fd) == 0 && status;
+}
+
+bool AccountDb::WriteDb(int *rc, unsigned nthreads)
+{
+    namespace sfs = std::filesystem;
+
     if (read_only_)
     {
         SetResultCode(rc, RC_ERR_READONLY);
         return false;
     }
-    std::unique_ptr<PwsDbRecord, decltype(&pws_free_db_records)> precords(ConvertToPwsafeRecords(), &pws_free_db_records);
-    const char *pn = db_pathname_.c_str(), *pw = password_.c_str();
-    return pws_db_write(pn, pw, precords.get(), rc);
+
+    // Replace the target of a symlink, not the symlink
+    std::error_code ec;
+    sfs::path pathname = db_pathname_;
+    if (sfs::is_symlink(pathname, ec))
+    {
+        pathname = fs::Canonical(pathname, ec);
+        if (ec)
+        {
+            SetResultCode(rc, RC_ERR_CANT_OPEN_FILE);
+            return false;
+        }
+    }
+
+    // Temporary file in the same directory so that it can be renamed over the database file
+    std::string tmp_pathname = pathname.string() + ".XXXXXX";
+    int fd = mkstemp(tmp_pathname.data());
+    if (fd < 0)
+    {
+        SetResultCode(rc, RC_ERR_CANT_OPEN_FILE);
+        return false;
+    }
+    // Keep the permissions of the existing file, mkstemp() creates the file readable only by the owner
+    if (struct stat st; stat(pathname.c_str(), &st) == 0)
+    {
+        fchmod(fd, st.st_mode & 07777);
+    }
+    close(fd);
+
+    PwsDbRecord *precords = ConvertToPwsafeRecords(nthreads);
+    const char *pw = password_.c_str();
+    bool status = pws_db_write(tmp_pathname.c_str(), pw, precords, rc);
+    if (status && durability_ != Durability::NONE && !Sync(tmp_pathname, O_RDONLY))
+    {
+        SetResultCode(rc, RC_FAILURE);
+        status = false;
+    }
+    if (status && rename(tmp_pathname.c_str(), pathname.c_str()) != 0)
+    {
+        SetResultCode(rc, RC_FAILURE);
+        status = false;
+    }
+    if (!status)
+    {
+        fs::Remove(tmp_pathname, ec);
+        return false;
+    }
+
+    if (durability_ == Durability::DIRECTORY)
+    {
+        sfs::path dir = pathname.parent_path();
+        if (!Sync(dir.empty() ? "." : dir.string(), O_RDONLY | O_DIRECTORY))
+        {
+            // The database file was replaced, it may not survive a crash
+            SetResultCode(rc, RC_FAILURE);
+            return false;
+        }
+    }
+
+    // The journal of the next change refers to the file just written
+    db_hash_ = fs::HashFile(db_pathname_, ec);
+    if (ec) db_hash_ = 0;
+    db_hash_pathname_ = db_pathname_;
+
+    // All changes are saved
+    RemoveJournal();
+    return true;
+}
+
+uint64_t AccountDb::DbHash()
+{
+    if (db_hash_pathname_ != db_pathname_)
+    {
+        std::error_code ec;
+        db_hash_ = fs::HashFile(db_pathname_, ec);
+        if (ec) db_hash_ = 0;
+        db_hash_pathname_ = db_pathname_;
+    }
+    return db_hash_;
+}
+
+bool AccountDb::WriteJournal(int *rc)
+{
+    if (read_only_)
+    {
+        SetResultCode(rc, RC_ERR_READONLY);
+        return false;
+    }
+    SetResultCode(rc, RC_SUCCESS);
+    if (records_.ChangeSeq() == journal_seq_)
+    {
+        return true;
+    }
+
+    // Changes before the dirty state was cleared are saved, 
+    // and `Modified()` only has the latest change to each record
+    const bool rewrite = !journal_.IsOpen() || journal_seq_ < records_.CleanSeq() 
+        || journal_.Size() > MAX_JOURNAL_SIZE;
+    const uint64_t since = rewrite ? 0 : journal_seq_;
+
+    std::vector<std::pair<uint64_t, Uuid>> changes;
+    for (const auto &[uuid, seq] : records_.Modified())
+    {
+        if (seq > since) changes.emplace_back(seq, uuid);
+    }
+    std::sort(changes.begin(), changes.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    std::vector<Journal::Entry> entries;
+    for (const auto &[seq, uuid] : changes)
+    {
+        auto it = records_.Find(uuid);
+        if (it == records_.end())
+        {
+            entries.push_back(Journal::Entry{Journal::Op::DELETE, uuid, {}});
+        }
+        else
+        {
+            entries.push_back(Journal::Entry{Journal::Op::SAVE, uuid, *it});
+        }
+    }
+    journal_seq_ = records_.ChangeSeq();
+
+    if (rewrite)
+    {
+        if (entries.empty())
+        {
+            RemoveJournal();
+            return true;
+        }
+        return journal_.Create(JournalPathname(), password_, DbHash(), entries, rc);
+    }
+    return journal_.Append(entries, rc);
+}
+
+bool AccountDb::ReplayJournal(int *rc)
+{
+    uint64_t db_hash;
+    std::vector<Journal::Entry> entries;
+    if (!Journal::Read(JournalPathname(), password_, db_hash, entries, rc))
+    {
+        return false;
+    }
+    if (db_hash != DbHash())
+    {
+        // The database file was saved after the journal was written
+        SetResultCode(rc, RC_ERR_CORRUPT_DB);
+        return false;
+    }
+
+    for (const Journal::Entry &entry : entries)
+    {
+        auto it = records_.Find(entry.uuid);
+        if (entry.op == Journal::Op::SAVE)
+        {
+            records_.Save(entry.record);
+        }
+        else if (it != records_.end())
+        {
+            records_.Delete(it);
+        }
+    }
+
+    // Start a new journal with the changes
+    journal_.Close();
+    journal_seq_ = 0;
+    return WriteJournal(rc);
+}
+
+void AccountDb::RemoveJournal()
+{
+    journal_.Close();
+    std::error_code ec;
+    fs::Remove(JournalPathname(), ec);
 }
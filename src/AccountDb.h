@@ -2,20 +2,34 @@
 #ifndef HAVE_ACCOUNTDB_H
 #define HAVE_ACCOUNTDB_H
 
+#include <functional>
 #include <memory>
 #include <vector>
 #include <string>
 #include <cassert>
+#include <unordered_map>
 
 #include "libpwsafe.h"
 
 #include "AccountRecords.h"
 #include "Filesystem.h"
+#include "Journal.h"
 #include "ResultCode.h"
 
 
 struct AccountDb
 {
+    /** How WriteDb() flushes the database file to storage before it returns */
+    enum class Durability
+    {
+        /** Do not flush, the OS writes the file later */
+        NONE,
+        /** Flush the file before it replaces the existing file */
+        FILE,
+        /** Flush the file, then flush its directory after the file is replaced */
+        DIRECTORY
+    };
+
     /** Pathname of database file */
     std::string &DbPathname()
     {
@@ -44,6 +58,12 @@ struct AccountDb
         return read_only_;
     }
 
+    /** Durability of WriteDb(), default `Durability::FILE` */
+    Durability &SaveDurability()
+    {
+        return durability_;
+    }
+
     /** Check if file at DbPathname() exists. */
     bool Exists() const;
 
@@ -81,31 +101,170 @@ struct AccountDb
         return CheckPassword(password_, rc);
     }
 
-    /** Read the account database at DbPathname() using Password() */
-    bool ReadDb(int *rc = nullptr);
+    /** 
+     * Read the account database at DbPathname() using Password().
+     * The password is validated while reading, the key is derived only once,
+     * so CheckPassword() is not needed before reading.
+     * \returns `RC_ERR_INCORRECT_PASSWORD` if the password is not correct,
+     *   `RC_ERR_FILE_DOESNT_EXIST` if the file does not exist,
+     *   `RC_ERR_CANT_OPEN_FILE` if the file cannot be read, or
+     *   `RC_ERR_CORRUPT_DB` if the file is not a valid account database
+     * \param nthreads Number of threads used to convert large databases,
+     *   if `0` the number of hardware threads is used
+     */
+    bool ReadDb(int *rc = nullptr, unsigned nthreads = 0);
+
+    /** 
+     * Receives the number of records converted since the last call,
+     * returns `false` to stop converting records.
+     * Called from the converting threads, possibly concurrently.
+     */
+    typedef std::function<bool(size_t)> ProgressCallback;
+
+    /** 
+     * Read and decrypt the records of the account database at `db_pathname`,
+     * then convert them on `nthreads` threads to `converted`, in file order.
+     * libpwsafe decrypts and verifies the whole file before any record is
+     * converted, `progress` is called as each batch of records is converted.
+     * Does not modify any `AccountDb`, so it can be called from a worker thread.
+     * On success the caller owns `*records`, see LoadRecords().
+     * `db_hash` is the hash of the file, see `Filesystem::HashFile()`.
+     * \returns The same result codes as ReadDb(), or `RC_USER_CANCEL` 
+     *   if `progress` stopped the conversion
+     */
+    static bool ReadPwsafeRecords(const std::string &db_pathname, const std::string &password, 
+        PwsDbRecord **records, std::vector<AccountRecord> &converted, uint64_t &db_hash, 
+        int *rc = nullptr, const ProgressCallback &progress = nullptr, unsigned nthreads = 0);
+
+    /** 
+     * Add the records converted by ReadPwsafeRecords() to Records().
+     * Takes ownership of `records`.
+     */
+    void LoadRecords(PwsDbRecord *records, std::vector<AccountRecord> &&converted, uint64_t db_hash);
+
+    /** 
+     * Use the journal key derived when the database was unlocked,
+     * so it is not derived when the first change is written to the journal.
+     */
+    void SetJournalSecret(const Journal::Secret &secret)
+    {
+        journal_.SetSecret(secret);
+    }
 
     /**
-     * Calls pws_db_write() to write the database records to 
-     * the file at DbPathname().
+     * Calls pws_db_write() to write the database records to a temporary
+     * file in the same directory, flushes it according to SaveDurability(),
+     * then renames it over the file at DbPathname(), so the existing file
+     * is replaced atomically and is never left partly written.
      * \returns `RC_ERR_READONLY` if ReadOnly() is `true`
+     * \param nthreads Number of threads used to convert modified records,
+     *   if `0` the number of hardware threads is used
     */
-    bool WriteDb(int *rc = nullptr);
+    bool WriteDb(int *rc = nullptr, unsigned nthreads = 0);
+
+    /** Pathname of the journal of unsaved changes to the database at DbPathname() */
+    std::string JournalPathname() const
+    {
+        return Journal::Pathname(db_pathname_);
+    }
+
+    /** Returns `true` if a journal of unsaved changes exists */
+    bool HasJournal() const
+    {
+        return fs::Exists(JournalPathname());
+    }
+
+    /** 
+     * Append the changes to Records() since the last call to the journal.
+     * A new journal is started after the dirty state is cleared, and when
+     * the journal grows larger than `MAX_JOURNAL_SIZE` it is rewritten 
+     * with only the latest change to each record.
+     * \returns `RC_ERR_READONLY` if ReadOnly() is `true`
+     */
+    bool WriteJournal(int *rc = nullptr);
+
+    /** 
+     * Apply the changes in the journal to Records(), then write them to a new journal.
+     * \returns `RC_ERR_FILE_DOESNT_EXIST` if there is no journal, 
+     *   `RC_ERR_CORRUPT_DB` if the journal is not valid or if it 
+     *   does not belong to the database file
+     */
+    bool ReplayJournal(int *rc = nullptr);
+
+    /** Remove the journal, discarding unsaved changes */
+    void RemoveJournal();
 
 private:
+    /** Size at which the journal is rewritten by WriteJournal() */
+    static constexpr size_t MAX_JOURNAL_SIZE = 1024 * 1024;
+
+    /** Frees a single pwsafe record, which may still be linked to other cached records */
+    struct PwsDbRecordDeleter
+    {
+        void operator()(PwsDbRecord *prec) const
+        {
+            prec->next = nullptr;
+            pws_free_db_records(prec);
+        }
+    };
+    typedef std::unique_ptr<PwsDbRecord, PwsDbRecordDeleter> PwsDbRecordPtr;
+
     std::string db_pathname_;
     std::string password_;
     bool read_only_ = false;
+    Durability durability_ = Durability::FILE;
     AccountRecords records_;
+    /** 
+     * Cache of the pwsafe records converted from the database records, by UUID.
+     * Only records modified since the cache was updated are converted again.
+     */
+    std::unordered_map<Uuid, PwsDbRecordPtr, Uuid::Hash> pws_records_;
+    /** Value of `AccountRecords::ChangeSeq()` when `pws_records_` was last updated */
+    uint64_t pws_records_seq_ = 0;
+    /** Hash of the file at `db_hash_pathname_` when it was last read or written */
+    uint64_t db_hash_ = 0;
+    std::string db_hash_pathname_;
+    /** Journal of unsaved changes */
+    Journal journal_;
+    /** Value of `AccountRecords::ChangeSeq()` when the journal was last written */
+    uint64_t journal_seq_ = 0;
+
+    /** 
+     * Convert pwsafe records to account records, in list order.
+     * \param nthreads Number of threads, if `0` the number of hardware threads is used
+     * \param progress Called as each batch of records is converted
+     * \returns `false` if `progress` stopped the conversion, `converted` is then empty
+     */
+    static bool ConvertRecords(const PwsDbRecord *records, unsigned nthreads, 
+        std::vector<AccountRecord> &converted, const ProgressCallback &progress = nullptr);
+
+    /** 
+     * Hash of the file at DbPathname(), `0` if it cannot be read.
+     * The file is hashed only if it was not read or written at DbPathname().
+     */
+    uint64_t DbHash();
+
+    /** Remove records modified since the last update from the cache of converted records */
+    void UpdatePwsafeRecordsCache();
+    /** Add the records read from the database to the cache of converted records */
+    void CachePwsafeRecords(PwsDbRecord *records);
 
     /** 
-     * Convert the database records to pwsafe records 
-     * Caller is responsible to free records by calling
-     * `pws_free_db_records()`
+     * Convert the database records to pwsafe records.
+     * The returned list links the cached records, it is valid until
+     * the next call and must not be freed by the caller.
+     * Returns `nullptr` if there are no records or on error.
+     * \param nthreads Number of threads used to convert many modified records,
+     *   if `0` the number of hardware threads is used
      */
-    PwsDbRecord *ConvertToPwsafeRecords();
+    PwsDbRecord *ConvertToPwsafeRecords(unsigned nthreads = 0);
 
 #ifdef FRIEND_TEST
     FRIEND_TEST(AccountDbTest, TestConvertToPwsafeSucceeds);
+    FRIEND_TEST(AccountDbTest, TestConvertToPwsafeReusesUnchangedRecords);
+    FRIEND_TEST(AccountDbTest, TestConvertRecordsParallelMatchesSerial);
+    FRIEND_TEST(AccountDbTest, TestConvertToPwsafeParallelMatchesSerial);
+    FRIEND_TEST(AccountDbTest, TestJournalReplay);
 #endif
 };
 
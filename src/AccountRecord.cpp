@@ -1,5 +1,7 @@
 /* Copyright 2023 Ian Boisvert */
 #include "AccountRecord.h"
+#include "Collation.h"
+#include "FuzzySearch.h"
 #include "libicu.h"
 
 AccountRecord AccountRecord::FromPwsDbRecord(const PwsDbRecord *prec)
@@ -16,42 +18,64 @@ AccountRecord AccountRecord::FromPwsDbRecord(const PwsDbRecord *prec)
     rec.SetField(FT_PASSWORD, pws_rec_get_field(prec, FT_PASSWORD));
     rec.SetField(FT_EMAIL, pws_rec_get_field(prec, FT_EMAIL));
     rec.SetField(FT_URL, pws_rec_get_field(prec, FT_URL));
+    // Fold the search text while loading, possibly on a worker thread,
+    // rather than on the first search
+    rec.SearchText();
+    rec.FuzzyText();
     return rec;
 }
 
-PwsDbRecord *AccountRecord::ToPwsDbRecord(PwsDbRecord *phead) const
+const std::string &AccountRecord::SortKey() const
 {
-    PwsDbRecord *prec = pws_add_record(phead);
-    if (prec)
+    if (sort_key_.empty())
+    {
+        AppendSortKey(GetField(FT_TITLE, ""), sort_key_);
+        AppendSortKey(GetField(FT_USER, ""), sort_key_);
+    }
+    return sort_key_;
+}
+
+const std::string &AccountRecord::SearchText() const
+{
+    if (search_text_.empty())
     {
-        for (auto &entry : fields_)
+        for (uint8_t field_type : SEARCH_FIELD_TYPES)
         {
-            const PwsFieldType field_type = (PwsFieldType)entry.first;
-            const char *value = entry.second.c_str();
-            pws_add_field(prec, field_type, value);
+            AppendFoldedText(GetField(field_type), search_text_);
+            search_text_.push_back('\0');
         }
     }
-    return prec;
+    return search_text_;
+}
+
+const std::string &AccountRecord::FuzzyText() const
+{
+    if (fuzzy_text_.empty())
+    {
+        for (uint8_t field_type : FUZZY_FIELD_TYPES)
+        {
+            AppendFoldedText(GetField(field_type), fuzzy_text_);
+            fuzzy_text_.push_back('\0');
+        }
+        fuzzy_mask_ = FuzzySearch::CharMask(fuzzy_text_);
+    }
+    return fuzzy_text_;
 }
 
-/** 
- * Returns `true` if the field exists and if the 
- * field value contains substring `substr`.
- * Substring is matched using case-insensitive comparison.
- */
-bool AccountRecord::FieldContainsCaseInsensitive(uint8_t field_type, const std::string &substr) const
+PwsDbRecord *AccountRecord::ToPwsDbRecord(PwsDbRecord *phead) const
 {
-    const char *field = GetField(field_type);
-    if (field)
+    PwsDbRecord *prec = pws_add_record(phead);
+    if (prec)
     {
-        icu::UnicodeString val(field);
-        icu::UnicodeString sub(substr.c_str());
-        if (val.toLower().indexOf(sub) != -1)
+        for (uint8_t field_type : FIELD_TYPES)
         {
-            return true;
+            if (const char *value = GetField(field_type))
+            {
+                pws_add_field(prec, (PwsFieldType)field_type, value);
+            }
         }
     }
-    return false;
+    return prec;
 }
 
 /**
@@ -2,43 +2,156 @@
 #ifndef HAVE_ACCOUNTRECORD_H
 #define HAVE_ACCOUNTRECORD_H
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 #include <array>
-#include <map>
+#include <memory>
+#include <utility>
 #include <cstring>
 #include "libpwsafe.h"
+#include "GroupNames.h"
 
+/**
+ * An account record.
+ *
+ * Field values are stored in a fixed table of slots, one per supported field type.
+ * The fields used to sort and display records (UUID, group, title, user) are
+ * stored in the record, the other fields are stored in a separate block that is 
+ * allocated only if one of those fields has a value. 
+ * A field that is not set has an empty value.
+ * 
+ * The group is a reference to an interned name in `GroupNames`.
+ *
+ * Records are sorted by the collation sort keys of the group, title and user.
+ * The sort key of the title and user is computed when it is first used
+ * after either field is changed.
+ *
+ * Searches match case-folded copies of the searched fields, which are
+ * computed when a record is converted from the database and cached until
+ * one of those fields is changed.
+ */
 class AccountRecord
 {
-    std::map<uint8_t, std::string> fields_;
-    mutable bool dirty_ = false;
-
 public:
-    typedef std::map<uint8_t, std::string>::value_type value_type;
+    typedef std::pair<uint8_t, std::string> value_type;
 
-    AccountRecord() = default;
+    /** Number of supported field types */
+    static constexpr size_t FIELD_COUNT = 9;
+    /** Supported field types, in the order they are written to the database */
+    static constexpr std::array<uint8_t, FIELD_COUNT> FIELD_TYPES{
+        FT_NAME, FT_UUID, FT_GROUP, FT_TITLE, FT_USER, FT_NOTES, FT_PASSWORD, FT_URL, FT_EMAIL
+    };
+    /** Field types matched by searches */
+    static constexpr std::array<uint8_t, 4> SEARCH_FIELD_TYPES{FT_TITLE, FT_NAME, FT_USER, FT_NOTES};
+    /** Field types matched by fuzzy searches */
+    static constexpr std::array<uint8_t, 4> FUZZY_FIELD_TYPES{FT_GROUP, FT_TITLE, FT_USER, FT_URL};
 
-    AccountRecord(const AccountRecord &src)
+private:
+    /** Hot fields, excluding the group */
+    static constexpr size_t HOT_COUNT = 3;
+    static constexpr size_t COLD_COUNT = FIELD_COUNT - HOT_COUNT - 1;
+    static constexpr int NO_SLOT = -1;
+
+    /** 
+     * Slot of a field type, hot fields first. 
+     * Returns `NO_SLOT` if field type is not supported or is `FT_GROUP`.
+     */
+    static constexpr int Slot(uint8_t field_type)
+    {
+        switch (field_type)
+        {
+        case FT_UUID: return 0;
+        case FT_TITLE: return 1;
+        case FT_USER: return 2;
+        case FT_NAME: return 3;
+        case FT_NOTES: return 4;
+        case FT_PASSWORD: return 5;
+        case FT_URL: return 6;
+        case FT_EMAIL: return 7;
+        default: return NO_SLOT;
+        }
+    }
+
+    typedef std::array<std::string, COLD_COUNT> ColdFields;
+
+    const GroupNames::Entry *group_ = &GroupNames::Instance().Empty();
+    std::array<std::string, HOT_COUNT> hot_;
+    std::unique_ptr<ColdFields> cold_;
+    /** Sort key of title and user, empty if not computed */
+    mutable std::string sort_key_;
+    /** Folded text of the searchable fields, empty if not computed */
+    mutable std::string search_text_;
+    /** Folded text of the fuzzy search fields, empty if not computed */
+    mutable std::string fuzzy_text_;
+    /** Character mask of `fuzzy_text_` */
+    mutable uint64_t fuzzy_mask_ = 0;
+
+    /** Returns `true` if `field_type` is one of `SEARCH_FIELD_TYPES` */
+    static constexpr bool IsSearchField(uint8_t field_type)
+    {
+        return field_type == FT_TITLE || field_type == FT_NAME || field_type == FT_USER || field_type == FT_NOTES;
+    }
+    /** Returns `true` if `field_type` is one of `FUZZY_FIELD_TYPES` */
+    static constexpr bool IsFuzzyField(uint8_t field_type)
+    {
+        return field_type == FT_GROUP || field_type == FT_TITLE || field_type == FT_USER || field_type == FT_URL;
+    }
+
+    /** Returns the value in `slot`, or `nullptr` if `slot` is a cold field and there are no cold fields */
+    const std::string *FindSlot(int slot) const
+    {
+        if (slot < static_cast<int>(HOT_COUNT)) return &hot_[slot];
+        if (!cold_) return nullptr;
+        return &(*cold_)[slot - HOT_COUNT];
+    }
+    std::string *FindSlot(int slot)
+    {
+        return const_cast<std::string *>(static_cast<const AccountRecord *>(this)->FindSlot(slot));
+    }
+    /** Returns the value in `slot`, allocating the cold fields if required */
+    std::string &GetSlot(int slot)
     {
-        this->fields_ = src.fields_;
+        if (slot >= static_cast<int>(HOT_COUNT) && !cold_)
+        {
+            cold_ = std::make_unique<ColdFields>();
+        }
+        return *FindSlot(slot);
     }
 
-    AccountRecord(std::initializer_list<value_type> fields):
-        fields_(fields)
+public:
+    AccountRecord() = default;
+
+    AccountRecord(const AccountRecord &src):
+        group_(src.group_),
+        hot_(src.hot_),
+        cold_(src.cold_ ? std::make_unique<ColdFields>(*src.cold_) : nullptr),
+        sort_key_(src.sort_key_),
+        search_text_(src.search_text_),
+        fuzzy_text_(src.fuzzy_text_),
+        fuzzy_mask_(src.fuzzy_mask_)
     {
         // empty
     }
 
-    /** Returns `true` if any field has been modified */
-    bool IsDirty() const
+    AccountRecord(AccountRecord &&src):
+        group_(src.group_),
+        hot_(std::move(src.hot_)),
+        cold_(std::move(src.cold_)),
+        sort_key_(std::move(src.sort_key_)),
+        search_text_(std::move(src.search_text_)),
+        fuzzy_text_(std::move(src.fuzzy_text_)),
+        fuzzy_mask_(src.fuzzy_mask_)
     {
-        return dirty_;
+        // empty
     }
-    /** Resets the dirty state to `false` */
-    void ClearDirty() const
+
+    AccountRecord(std::initializer_list<value_type> fields)
     {
-        dirty_ = false;
+        for (const value_type &field : fields)
+        {
+            SetField(field.first, field.second.c_str());
+        }
     }
 
     static AccountRecord FromPwsDbRecord(const PwsDbRecord *prec);
@@ -58,55 +171,145 @@ public:
 
     AccountRecord &operator =(AccountRecord src)
     {
-        if (fields_ != src.fields_)
-        {
-            swap(*this, src);
-            dirty_ = true;
-        }
+        swap(*this, src);
         return *this;
     }
 
     bool operator==(const AccountRecord &other) const
     {
-        return fields_ == other.fields_;
+        if (group_ != other.group_ || hot_ != other.hot_) return false;
+        if (cold_ && other.cold_) return *cold_ == *other.cold_;
+        const ColdFields *cold = cold_ ? cold_.get() : other.cold_.get();
+        return !cold || std::all_of(cold->begin(), cold->end(), [](const std::string &value) {
+            return value.empty();
+        });
+    }
+
+    /** ID of the interned group name */
+    GroupNames::Id GroupId() const
+    {
+        return group_->id;
+    }
+
+    /** Interned group name */
+    const GroupNames::Entry &Group() const
+    {
+        return *group_;
+    }
+
+    /** 
+     * Collation sort key of the title and user.
+     * The key is computed on first use and cached until either field is changed.
+     */
+    const std::string &SortKey() const;
+
+    /**
+     * Case-folded text of the searchable fields, see `AppendFoldedText()`.
+     * Each field in `SEARCH_FIELD_TYPES` is followed by a 0 byte, so a
+     * folded query never matches across fields.
+     * The text is computed on first use and cached until one of the fields is changed.
+     */
+    const std::string &SearchText() const;
+
+    /**
+     * Returns `true` if a searchable field contains `folded_query`,
+     * which must be folded with `AppendFoldedText()`.
+     */
+    bool SearchTextContains(const std::string &folded_query) const
+    {
+        return SearchText().find(folded_query) != std::string::npos;
+    }
+
+    /**
+     * Case-folded text of the fuzzy search fields, see `FuzzySearch`.
+     * Each field in `FUZZY_FIELD_TYPES` is followed by a 0 byte.
+     * The text is computed on first use and cached until one of the fields is changed.
+     */
+    const std::string &FuzzyText() const;
+
+    /** Character mask of `FuzzyText()`, see `FuzzySearch::CharMask()` */
+    uint64_t FuzzyMask() const
+    {
+        FuzzyText();
+        return fuzzy_mask_;
     }
 
     const char *GetField(uint8_t field_type, const char *default_value = nullptr) const
     {
-        auto it = fields_.find(field_type);
-        const char *value = nullptr;
-        if (it != fields_.end())
+        if (field_type == FT_GROUP)
+        {
+            return group_->name.empty() ? default_value : group_->name.c_str();
+        }
+
+        int slot = Slot(field_type);
+        if (slot != NO_SLOT)
         {
-            value = fields_.at(field_type).c_str();
+            const std::string *value = FindSlot(slot);
+            if (value && !value->empty()) return value->c_str();
         }
-        if (!value) value = default_value;
-        return value;
+        return default_value;
     }
 
+    /** 
+     * Set the value of a field. 
+     * Setting a `null` or empty value clears the field.
+     * Field types not in `FIELD_TYPES` are ignored.
+     */
     void SetField(uint8_t field_type, const char *value)
     {
+        if (field_type == FT_GROUP)
+        {
+            const GroupNames::Entry *group = &GroupNames::Instance().Intern(value);
+            if (group != group_)
+            {
+                group_ = group;
+                fuzzy_text_.clear();
+            }
+            return;
+        }
+
+        int slot = Slot(field_type);
+        assert(slot != NO_SLOT);
+        if (slot == NO_SLOT) return;
+
         if (value && *value)
         {
-            fields_[field_type] = value;
-            dirty_ = true;
+            std::string &field = GetSlot(slot);
+            if (field == value) return;
+            field = value;
+        }
+        else if (std::string *field = FindSlot(slot); field && !field->empty())
+        {
+            field->clear();
         }
         else
         {
-            fields_.erase(field_type);
+            return;
+        }
+        if (field_type == FT_TITLE || field_type == FT_USER)
+        {
+            sort_key_.clear();
+        }
+        if (IsSearchField(field_type))
+        {
+            search_text_.clear();
+        }
+        if (IsFuzzyField(field_type))
+        {
+            fuzzy_text_.clear();
         }
     }
 
-    /** 
-     * Returns `true` if the field exists and if the 
-     * field value contains substring `substr`.
-     * Substring is matched using case-insensitive comparison.
-     */
-    bool FieldContainsCaseInsensitive(uint8_t field_type, const std::string &substr) const;
-
     friend void swap(AccountRecord &src, AccountRecord &dst)
     {
         using std::swap;
-        swap(src.fields_, dst.fields_);
+        swap(src.group_, dst.group_);
+        swap(src.hot_, dst.hot_);
+        swap(src.cold_, dst.cold_);
+        swap(src.sort_key_, dst.sort_key_);
+        swap(src.search_text_, dst.search_text_);
+        swap(src.fuzzy_text_, dst.fuzzy_text_);
+        swap(src.fuzzy_mask_, dst.fuzzy_mask_);
     }
 };
 
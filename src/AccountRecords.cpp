@@ -1,41 +1,125 @@
 /* Copyright 2023 Ian Boisvert */
+#include <algorithm>
+
 #include "AccountRecords.h"
+#include "Parallel.h"
 #include "Utils.h"
 
-AccountRecords::iterator AccountRecords::FindRecordByUuid(const char *uuid)
+// Collections smaller than this are always sorted on the calling thread
+static constexpr size_t MIN_PARALLEL_SORT_SIZE = 16384;
+// Searches having more candidates than 1/DENSE_MATCH_RATIO of the records scan the records
+// in sort order rather than finding the position of each candidate
+static constexpr size_t DENSE_MATCH_RATIO = 64;
+
+AccountRecords::RecordId AccountRecords::FindRecordByUuid(const char *uuid) const
+{
+    if (!uuid || !*uuid)
+    {
+        return NO_ID;
+    }
+    auto it = uuid_index_.find(Uuid::FromString(uuid));
+    return it == uuid_index_.end() ? NO_ID : it->second;
+}
+
+/** Binary search for the position of record `id`, records must be sorted */
+std::vector<AccountRecords::RecordId>::iterator AccountRecords::FindPosition(RecordId id)
 {
-    const AccountRecord uuid_rec{{FT_UUID, uuid}};
-    return std::find_if(records_.begin(), records_.end(), 
-            [&uuid_rec](const AccountRecord& rec) { return FieldCompare(FT_UUID, uuid_rec, rec); });
+    auto pos = std::lower_bound(order_.begin(), order_.end(), id, 
+        [this](RecordId a, RecordId b) { return CompareIds(a, b); });
+    assert(pos != order_.end() && *pos == id);
+    return pos;
 }
 
-bool AccountRecords::CompareRecords(const AccountRecord &a, const AccountRecord &b)
+AccountRecords::iterator AccountRecords::Find(RecordId id)
 {
-    int group_lt = strcmp(a.GetField(FT_GROUP, ""), b.GetField(FT_GROUP, ""));
-    if (group_lt == 0)
+    return const_iterator(this, FindPosition(id));
+}
+
+void AccountRecords::BuildGroupRanges()
+{
+    group_ranges_.clear();
+    for (size_t pos = 0, len = order_.size(); pos < len; ++pos)
     {
-        int title_lt = strcmp(a.GetField(FT_TITLE, ""), b.GetField(FT_TITLE, ""));
-        if (title_lt == 0)
+        GroupNames::Id group = store_[order_[pos]].GroupId();
+        if (group_ranges_.empty() || group_ranges_.back().group != group)
         {
-            int user_lt = strcmp(a.GetField(FT_USER, ""), b.GetField(FT_USER, ""));
-            if (user_lt == 0)
-            {
-                int uuid_lt = strcmp(a.GetField(FT_UUID, ""), b.GetField(FT_UUID, ""));
-                if (uuid_lt < 0)
-                    return true;
-            }
-            else if (user_lt < 0)
-                return true;
+            group_ranges_.push_back({group, pos, pos});
         }
-        else if (title_lt < 0)
-            return true;
+        ++group_ranges_.back().end;
+    }
+    group_range_index_.clear();
+    ReindexGroupRanges(0);
+}
+
+void AccountRecords::ReindexGroupRanges(size_t from)
+{
+    for (size_t len = group_ranges_.size(); from < len; ++from)
+    {
+        group_range_index_[group_ranges_[from].group] = from;
+    }
+}
+
+void AccountRecords::AddToGroupRanges(size_t pos, GroupNames::Id group)
+{
+    size_t index;
+    if (auto it = group_range_index_.find(group); it != group_range_index_.end())
+    {
+        index = it->second;
+        ++group_ranges_[index].end;
+    }
+    else
+    {
+        // New group, insert range before the group that is at `pos`
+        auto range_it = std::lower_bound(group_ranges_.begin(), group_ranges_.end(), pos, 
+            [](const GroupRange &range, size_t pos) { return range.begin < pos; });
+        range_it = group_ranges_.insert(range_it, {group, pos, pos+1});
+        index = range_it - group_ranges_.begin();
+        ReindexGroupRanges(index);
+    }
+    for (size_t i = index+1, len = group_ranges_.size(); i < len; ++i)
+    {
+        ++group_ranges_[i].begin;
+        ++group_ranges_[i].end;
     }
-    else if (group_lt < 0)
-        return true;
-    return false;
 }
 
-AccountRecords::iterator AccountRecords::InsertRecord(const AccountRecord &rec)
+void AccountRecords::RemoveFromGroupRanges(size_t /*pos*/, GroupNames::Id group)
+{
+    auto it = group_range_index_.find(group);
+    assert(it != group_range_index_.end());
+    size_t index = it->second;
+    for (size_t i = index+1, len = group_ranges_.size(); i < len; ++i)
+    {
+        --group_ranges_[i].begin;
+        --group_ranges_[i].end;
+    }
+    if (--group_ranges_[index].end == group_ranges_[index].begin)
+    {
+        group_range_index_.erase(it);
+        group_ranges_.erase(group_ranges_.begin() + index);
+        ReindexGroupRanges(index);
+    }
+}
+
+bool AccountRecords::CompareRecords(const AccountRecord &a, const AccountRecord &b)
+{
+    if (a.GroupId() != b.GroupId())
+    {
+        const GroupNames::Entry &group_a = a.Group(), &group_b = b.Group();
+        int group_cmp = group_a.sort_key.compare(group_b.sort_key);
+        // Different groups must not compare equal, or records of the groups would be interleaved
+        if (group_cmp == 0) group_cmp = group_a.name.compare(group_b.name);
+        return group_cmp < 0;
+    }
+    int key_cmp = a.SortKey().compare(b.SortKey());
+    if (key_cmp == 0)
+    {
+        return strcmp(a.GetField(FT_UUID, ""), b.GetField(FT_UUID, "")) < 0;
+    }
+    return key_cmp < 0;
+}
+
+AccountRecords::RecordId AccountRecords::InsertRecord(AccountRecord rec)
 {
     bool update_uuid = false;
 
@@ -45,39 +129,209 @@ AccountRecords::iterator AccountRecords::InsertRecord(const AccountRecord &rec)
         update_uuid = true;
     }
 
-    iterator it = records_.insert(records_.end(), rec);
+    RecordId id;
+    if (free_ids_.empty())
+    {
+        id = store_.size();
+        store_.push_back(std::move(rec));
+    }
+    else
+    {
+        id = free_ids_.back();
+        free_ids_.pop_back();
+        swap(store_[id], rec);
+    }
+    AccountRecord &stored = store_[id];
     if (update_uuid) 
     {
         char uuid[33];
         if (pws_generate_uuid(uuid) == PRC_SUCCESS)
         {
-            it->SetField(FT_UUID, uuid);
+            stored.SetField(FT_UUID, uuid);
         }
     }
+    uuid_index_[Uuid::FromString(stored.GetField(FT_UUID))] = id;
+    if (search_index_built_)
+    {
+        search_index_.Add(id, stored.SearchText());
+    }
 
-    return it;
+    return id;
 }
 
-AccountRecords::iterator AccountRecords::UpdateRecord(const AccountRecord &rec)
+AccountRecords::RecordId AccountRecords::UpdateRecord(const AccountRecord &rec)
 {
-    AccountRecords::iterator it = FindRecordByUuid(rec.GetField(FT_UUID, ""));
-    if (it != records_.end()) *it = rec;
-    return it;
+    RecordId id = FindRecordByUuid(rec.GetField(FT_UUID, ""));
+    if (id != NO_ID)
+    {
+        if (search_index_built_)
+        {
+            search_index_.Update(id, store_[id].SearchText(), rec.SearchText());
+        }
+        store_[id] = rec;
+    }
+    return id;
 }
 
-AccountRecords::iterator AccountRecords::Save(const AccountRecord &rec)
+void AccountRecords::BuildSearchIndex()
 {
-    iterator it;
-    if (it = UpdateRecord(rec); it == records_.end())
+    search_index_.Clear();
+    // Deleted records are empty and have no trigrams
+    for (RecordId id = 0, len = store_.size(); id < len; ++id)
     {
-        it = InsertRecord(rec);
-        dirty_ = true;
+        search_index_.Add(id, store_[id].SearchText());
     }
-    std::string uuid = it->GetField(FT_UUID, "");
+    search_index_built_ = true;
+}
 
-    // Sort records after insert
-    std::sort(records_.begin(), records_.end(), CompareRecords);
+std::vector<size_t> AccountRecords::FindMatches(const std::string &folded_query)
+{
+    std::vector<size_t> positions;
 
-    it = FindRecordByUuid(uuid.c_str());
-    return it;
+    if (!search_index_built_)
+    {
+        BuildSearchIndex();
+    }
+    std::vector<RecordId> candidates;
+    if (!search_index_.FindCandidates(folded_query, candidates))
+    {
+        for (size_t pos = 0, len = order_.size(); pos < len; ++pos)
+        {
+            if (store_[order_[pos]].SearchTextContains(folded_query))
+            {
+                positions.push_back(pos);
+            }
+        }
+    }
+    else if (candidates.size() > size() / DENSE_MATCH_RATIO)
+    {
+        std::vector<bool> is_candidate(store_.size());
+        for (RecordId id : candidates)
+        {
+            is_candidate[id] = true;
+        }
+        for (size_t pos = 0, len = order_.size(); pos < len; ++pos)
+        {
+            RecordId id = order_[pos];
+            if (is_candidate[id] && store_[id].SearchTextContains(folded_query))
+            {
+                positions.push_back(pos);
+            }
+        }
+    }
+    else
+    {
+        for (RecordId id : candidates)
+        {
+            if (store_[id].SearchTextContains(folded_query))
+            {
+                positions.push_back(FindPosition(id) - order_.begin());
+            }
+        }
+        std::sort(positions.begin(), positions.end());
+    }
+    return positions;
+}
+
+/**
+ * Sort the records in `nthreads` chunks on separate threads,
+ * then merge the sorted chunks pairwise.
+ */
+void AccountRecords::SortRecords(unsigned nthreads)
+{
+    auto compare = [this](RecordId a, RecordId b) { return CompareIds(a, b); };
+
+    // Sort keys of the records in a chunk are computed by the thread sorting the chunk
+    const size_t len = order_.size();
+    const unsigned nchunks = ParallelFor(len, nthreads, MIN_PARALLEL_SORT_SIZE, [this, &compare](size_t begin, size_t end) {
+        std::sort(order_.begin() + begin, order_.begin() + end, compare);
+    });
+
+    // Merge pairs of adjacent sorted chunks until one chunk remains
+    for (size_t width = 1; width < nchunks; width *= 2)
+    {
+        for (size_t i = 0; i + width < nchunks; i += 2 * width)
+        {
+            size_t begin = len * i / nchunks, mid = len * (i + width) / nchunks;
+            size_t end = len * std::min<size_t>(i + 2 * width, nchunks) / nchunks;
+            std::inplace_merge(order_.begin() + begin, order_.begin() + mid, order_.begin() + end, compare);
+        }
+    }
+    BuildGroupRanges();
+}
+
+AccountRecords::RecordId AccountRecords::Save(const AccountRecord &rec)
+{
+    auto compare = [this](RecordId a, RecordId b) { return CompareIds(a, b); };
+
+    RecordId id = FindRecordByUuid(rec.GetField(FT_UUID, ""));
+    if (id == NO_ID)
+    {
+        id = InsertRecord(rec);
+        auto pos = std::lower_bound(order_.begin(), order_.end(), id, compare);
+        pos = order_.insert(pos, id);
+        AddToGroupRanges(pos - order_.begin(), store_[id].GroupId());
+        MarkModified(Uuid::FromString(store_[id].GetField(FT_UUID)));
+        return id;
+    }
+    if (store_[id] == rec)
+    {
+        return id;
+    }
+    MarkModified(Uuid::FromString(rec.GetField(FT_UUID)));
+
+    // Find the current position before the sort key is changed
+    auto pos = FindPosition(id);
+    const GroupNames::Id old_group = store_[id].GroupId();
+    size_t old_index = pos - order_.begin(), new_index = old_index;
+    if (search_index_built_)
+    {
+        search_index_.Update(id, store_[id].SearchText(), rec.SearchText());
+    }
+    store_[id] = rec;
+
+    // Move the record to its new position by rotating the 
+    // records between the old and new positions
+    if (pos != order_.begin() && compare(id, *(pos-1)))
+    {
+        auto new_pos = std::upper_bound(order_.begin(), pos, id, compare);
+        std::rotate(new_pos, pos, pos+1);
+        new_index = new_pos - order_.begin();
+    }
+    else if (pos+1 != order_.end() && compare(*(pos+1), id))
+    {
+        auto new_pos = std::lower_bound(pos+1, order_.end(), id, compare);
+        std::rotate(pos, pos+1, new_pos);
+        new_index = new_pos - order_.begin() - 1;
+    }
+
+    // Records stay within their group range unless the group changed
+    if (const GroupNames::Id new_group = store_[id].GroupId(); new_group != old_group)
+    {
+        RemoveFromGroupRanges(old_index, old_group);
+        AddToGroupRanges(new_index, new_group);
+    }
+    return id;
+}
+
+bool AccountRecords::Delete(const AccountRecord &rec)
+{
+    if (RecordId id = FindRecordByUuid(rec.GetField(FT_UUID)); id != NO_ID)
+    {
+        auto pos = FindPosition(id);
+        RemoveFromGroupRanges(pos - order_.begin(), store_[id].GroupId());
+        order_.erase(pos);
+        const Uuid uuid = Uuid::FromString(store_[id].GetField(FT_UUID));
+        uuid_index_.erase(uuid);
+        MarkModified(uuid);
+        if (search_index_built_)
+        {
+            search_index_.Remove(id, store_[id].SearchText());
+        }
+        AccountRecord empty;
+        swap(store_[id], empty);
+        free_ids_.push_back(id);
+        return true;
+    }
+    return false;
 }
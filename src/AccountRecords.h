@@ -2,115 +2,398 @@
 #ifndef HAVE_ACCOUNTRECORDS_H
 #define HAVE_ACCOUNTRECORDS_H
 
+#include <cstdint>
+#include <deque>
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <iterator>
+#include <unordered_map>
 
 #include "libicu.h"
 #include "AccountRecord.h"
+#include "SearchIndex.h"
+#include "Uuid.h"
 
 class AccountRecords
 {
 public:
-    typedef std::vector<AccountRecord> AccountRecordCollection;
-    typedef AccountRecordCollection::iterator iterator;
-    typedef AccountRecordCollection::const_iterator const_iterator;
+    /** 
+     * Stable handle to a record in the collection. 
+     * A record keeps its ID until it is deleted, regardless of
+     * records inserted or moved by sorting.
+     */
+    typedef uint32_t RecordId;
+
+    /** Random access iterator over the records in sort order */
+    class const_iterator
+    {
+        friend class AccountRecords;
+
+        const AccountRecords *records_ = nullptr;
+        std::vector<RecordId>::const_iterator pos_;
+
+        const_iterator(const AccountRecords *records, std::vector<RecordId>::const_iterator pos):
+            records_(records), pos_(pos)
+        {
+            // empty
+        }
+
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef AccountRecord value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const AccountRecord *pointer;
+        typedef const AccountRecord &reference;
+
+        const_iterator() = default;
+
+        /** ID of the record at the iterator position */
+        RecordId Id() const
+        {
+            return *pos_;
+        }
+
+        reference operator*() const
+        {
+            return records_->store_[*pos_];
+        }
+        pointer operator->() const
+        {
+            return &records_->store_[*pos_];
+        }
+        reference operator[](difference_type n) const
+        {
+            return records_->store_[pos_[n]];
+        }
+
+        const_iterator &operator++()
+        {
+            ++pos_;
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator it = *this;
+            ++pos_;
+            return it;
+        }
+        const_iterator &operator--()
+        {
+            --pos_;
+            return *this;
+        }
+        const_iterator operator--(int)
+        {
+            const_iterator it = *this;
+            --pos_;
+            return it;
+        }
+        const_iterator &operator+=(difference_type n)
+        {
+            pos_ += n;
+            return *this;
+        }
+        const_iterator &operator-=(difference_type n)
+        {
+            pos_ -= n;
+            return *this;
+        }
+        const_iterator operator+(difference_type n) const
+        {
+            return const_iterator(records_, pos_ + n);
+        }
+        const_iterator operator-(difference_type n) const
+        {
+            return const_iterator(records_, pos_ - n);
+        }
+        difference_type operator-(const const_iterator &other) const
+        {
+            return pos_ - other.pos_;
+        }
+
+        bool operator==(const const_iterator &other) const
+        {
+            return pos_ == other.pos_;
+        }
+        bool operator!=(const const_iterator &other) const
+        {
+            return pos_ != other.pos_;
+        }
+        bool operator<(const const_iterator &other) const
+        {
+            return pos_ < other.pos_;
+        }
+        bool operator>(const const_iterator &other) const
+        {
+            return pos_ > other.pos_;
+        }
+        bool operator<=(const const_iterator &other) const
+        {
+            return pos_ <= other.pos_;
+        }
+        bool operator>=(const const_iterator &other) const
+        {
+            return pos_ >= other.pos_;
+        }
+    };
+    /** 
+     * Records are modified only by Save() so that the sort order
+     * and the UUID index stay consistent.
+     */
+    typedef const_iterator iterator;
+
+    /** Positions [begin, end) in sort order of the records in a group */
+    struct GroupRange
+    {
+        GroupNames::Id group;
+        size_t begin;
+        size_t end;
+    };
 
 private:
+    /** 
+     * Order records by group, title and user using the cached collation sort keys,
+     * then by UUID.
+     */
     static bool CompareRecords(const AccountRecord &a, const AccountRecord &b);
 
-    AccountRecordCollection records_;
-    mutable bool dirty_ = false;
+    /** 
+     * Record storage, indexed by RecordId. 
+     * Elements of a deque are not moved when it grows, so
+     * references to records remain valid until the record is deleted.
+     */
+    std::deque<AccountRecord> store_;
+    /** IDs of deleted records, available for reuse */
+    std::vector<RecordId> free_ids_;
+    /** Record IDs in sort order */
+    std::vector<RecordId> order_;
+    /** ID of each record, by UUID */
+    std::unordered_map<Uuid, RecordId, Uuid::Hash> uuid_index_;
+    /** Group ranges in sort order */
+    std::vector<GroupRange> group_ranges_;
+    /** Index in `group_ranges_` by group ID */
+    std::unordered_map<GroupNames::Id, size_t> group_range_index_;
+    /** Trigram index of the search text of the records, built on first search */
+    SearchIndex search_index_;
+    bool search_index_built_ = false;
+    /** Incremented for each change to the collection */
+    uint64_t change_seq_ = 0;
+    /** Value of `change_seq_` when the dirty state was last cleared */
+    mutable uint64_t clean_seq_ = 0;
+    /** 
+     * UUIDs of the records inserted, updated or deleted since the dirty state
+     * was last cleared, with the value of `change_seq_` of the last change
+     */
+    mutable std::unordered_map<Uuid, uint64_t, Uuid::Hash> modified_;
 
-    iterator FindRecordByUuid(const char *uuid);
+    /** Record a change to the record with `uuid` */
+    void MarkModified(const Uuid &uuid)
+    {
+        modified_[uuid] = ++change_seq_;
+    }
+
+    bool CompareIds(RecordId a, RecordId b) const
+    {
+        return CompareRecords(store_[a], store_[b]);
+    }
+
+    /** Returns the ID of the record with `uuid`, or `NO_ID` */
+    RecordId FindRecordByUuid(const char *uuid) const;
+    /** Returns the position in the sort order of record `id` */
+    std::vector<RecordId>::iterator FindPosition(RecordId id);
+
+    /** Rebuild `group_ranges_` from the sorted records */
+    void BuildGroupRanges();
+    /** Update `group_range_index_` for group ranges at index `from` and later */
+    void ReindexGroupRanges(size_t from);
+    /** Update group ranges after a record in `group` is inserted at position `pos` */
+    void AddToGroupRanges(size_t pos, GroupNames::Id group);
+    /** Update group ranges after a record in `group` is removed from position `pos` */
+    void RemoveFromGroupRanges(size_t pos, GroupNames::Id group);
+
+    /** Index the search text of all records */
+    void BuildSearchIndex();
 
     /** Insert record without sorting, to be used when reading db */
-    iterator InsertRecord(const AccountRecord &rec);
+    RecordId InsertRecord(AccountRecord rec);
     /** Update an existing record without sorting, to be used when reading db */
-    iterator UpdateRecord(const AccountRecord &rec);
-    /** Sort all records, to be used after reading db */
-    void SortRecords();
+    RecordId UpdateRecord(const AccountRecord &rec);
 
 public:
+    /** Invalid record ID */
+    static constexpr RecordId NO_ID = static_cast<RecordId>(-1);
 
     AccountRecords() = default;
 
-    AccountRecords(std::initializer_list<AccountRecord> records):
-        records_(records)
+    AccountRecords(std::initializer_list<AccountRecord> records)
     {
-        // empty
+        for (const AccountRecord &rec : records)
+        {
+            order_.push_back(InsertRecord(rec));
+        }
+        SortRecords(/*nthreads*/ 1);
     }
 
-    iterator begin()
+    const_iterator begin() const
     {
-        return records_.begin();
+        return const_iterator(this, order_.begin());
     }
-    const_iterator begin() const
+    const_iterator end() const
     {
-        return records_.begin();
+        return const_iterator(this, order_.end());
     }
 
-    iterator end()
+    /** Number of records */
+    size_t size() const
     {
-        return records_.end();
+        return order_.size();
     }
-    const_iterator end() const
+
+    /** Record having ID `id` */
+    const AccountRecord &operator[](RecordId id) const
+    {
+        assert(id < store_.size());
+        return store_[id];
+    }
+
+    /** Find the record having ID `id` */
+    iterator Find(RecordId id);
+
+    /** Find the record having `uuid` */
+    iterator Find(const Uuid &uuid)
+    {
+        auto it = uuid_index_.find(uuid);
+        return it == uuid_index_.end() ? end() : Find(it->second);
+    }
+
+    /** Position ranges of the records in each group, in sort order */
+    const std::vector<GroupRange> &GroupRanges() const
+    {
+        return group_ranges_;
+    }
+
+    /** Position range of the records in `group`, `nullptr` if the group has no records */
+    const GroupRange *FindGroupRange(GroupNames::Id group) const
     {
-        return records_.end();
+        auto it = group_range_index_.find(group);
+        return it == group_range_index_.end() ? nullptr : &group_ranges_[it->second];
     }
 
     /** Find an account record having the given field value */
     iterator Find(PwsFieldType field_type, const std::string &value)
     {
+        if (field_type == FT_UUID)
+        {
+            RecordId id = FindRecordByUuid(value.c_str());
+            return id == NO_ID ? end() : Find(id);
+        }
         icu::UnicodeString ustr{value.c_str()};
-        return std::find_if(records_.begin(), records_.end(), [field_type, &ustr](const auto &rec){
+        return std::find_if(begin(), end(), [field_type, &ustr](const auto &rec){
             return ustr == icu::UnicodeString{rec.GetField(field_type)};
         });
     }
 
+    /**
+     * Find all records whose search text contains `folded_query`,
+     * see `AccountRecord::SearchTextContains()`.
+     *
+     * Candidate records are found with a trigram index of the search text,
+     * which is built on the first search and updated when records are changed.
+     * \returns Positions in sort order of the matching records, ascending
+     */
+    std::vector<size_t> FindMatches(const std::string &folded_query);
+
     /** 
      * Insert a new record or update an existing record that has the same value
      * of the FT_UUID field.
      * 
      * If the record does not have a UUID field or the value is null or empty,
-     * a unique UUID will be assigned to the record
-     * \returns A reference to the account record
+     * a unique UUID will be assigned to the record.
+     *
+     * The record is moved to its sorted position, the collection is not re-sorted.
+     * \returns The ID of the account record
      * \remark
      * If record has `null` or empty value of `FT_UUID` field, 
      * a unique UUID will be generated and stored.
      */
-    iterator Save(const AccountRecord &rec);
-    
-    bool Delete(const AccountRecord &rec)
+    RecordId Save(const AccountRecord &rec);
+
+    /** Reserve storage for `count` records, to be used before bulk loading records */
+    void Reserve(size_t count)
+    {
+        order_.reserve(count);
+        uuid_index_.reserve(count);
+    }
+
+    /**
+     * Insert a new record or update an existing record that has the same value
+     * of the FT_UUID field, without sorting.
+     *
+     * This is the bulk load path used when reading a database: 
+     * SortRecords() must be called after the last record is appended
+     * and before the collection is used.
+     */
+    void Append(AccountRecord &&rec)
     {
-        if (iterator it = FindRecordByUuid(rec.GetField(FT_UUID)); it != records_.end())
+        RecordId id = UpdateRecord(rec);
+        if (id == NO_ID)
         {
-            records_.erase(it);
-            dirty_ = true;
-            return true;
+            id = InsertRecord(std::move(rec));
+            order_.push_back(id);
         }
-        return false;
+        MarkModified(Uuid::FromString(store_[id].GetField(FT_UUID)));
     }
 
+    /**
+     * Sort all records, to be used after bulk loading records with Append().
+     * \param nthreads Number of threads used to sort large collections,
+     *   if `0` the number of hardware threads is used
+     */
+    void SortRecords(unsigned nthreads = 0);
+
+    bool Delete(const AccountRecord &rec);
+
     bool Delete(iterator it)
     {
         return Delete(*it);
     }
 
-    /** Returns `true` if the collection or elements of the collection have been modified */
+    /** Returns `true` if records have been inserted, updated or deleted since the dirty state was cleared */
     bool IsDirty() const
     {
-        return dirty_ || std::any_of(records_.begin(), records_.end(), [](const AccountRecord &rec) {
-            return rec.IsDirty();
-        });
+        return change_seq_ != clean_seq_;
     }
     /** Resets the dirty state to `false` */
     void ClearDirty() const
     {
-        dirty_ = false;
-        std::for_each(records_.begin(), records_.end(), [](const AccountRecord &rec) {
-            rec.ClearDirty();
-        });
+        clean_seq_ = change_seq_;
+        modified_.clear();
+    }
+
+    /** 
+     * Change counter, incremented each time a record is inserted, 
+     * updated with a different value, or deleted
+     */
+    uint64_t ChangeSeq() const
+    {
+        return change_seq_;
+    }
+
+    /** Value of `ChangeSeq()` when the dirty state was last cleared */
+    uint64_t CleanSeq() const
+    {
+        return clean_seq_;
+    }
+
+    /** 
+     * UUIDs of the records modified since the dirty state was cleared,
+     * including deleted records, with the value of `ChangeSeq()` 
+     * after the last change to each record
+     */
+    const std::unordered_map<Uuid, uint64_t, Uuid::Hash> &Modified() const
+    {
+        return modified_;
     }
 };
 
@@ -193,13 +193,15 @@ AccountsWin::AccountsWin(PWSafeApp &app, WINDOW *win) : app_(app), win_(win)
     // clang-format off
     app.GetCommandBar().Register(this, {
         {"Enter", "View", "View the account properties"}, 
-        {~CBOPTS_READONLY, "^A", "Add", "Add a new account"},
-        {~CBOPTS_READONLY, "^D", "Delete", "Delete an account"},
+        {CBOPTS_WRITABLE, "^A", "Add", "Add a new account"},
+        {CBOPTS_WRITABLE, "^D", "Delete", "Delete an account"},
         {"^U", "Copy user", "Copy the account user name to the clipboard"},
         {"^P", "Copy password", "Copy the account password to the clipboard"},
-        {~CBOPTS_READONLY, "^S", "Save and exit", "Save changes to the database and exit"},
+        {CBOPTS_WRITABLE, "^S", "Save and exit", "Save changes to the database and exit"},
         {"^X", "Exit", "Exit without saving changes"},
-        {~CBOPTS_READONLY, "^C", "Change password", "Change the account database password"}
+        {CBOPTS_WRITABLE, "^C", "Change password", "Change the account database password"},
+        {"Tab", "Next group", "Select the next account group, Shift+Tab selects the previous group"},
+        {CBOPTS_FILTERED, "Esc", "Show all", "Show all accounts after a search filtered the list"}
     });
     // clang-format on
 }
@@ -228,11 +230,11 @@ void AccountsWin::SetSelection(const AccountRecord &record) const
 
 const AccountRecord *AccountsWin::GetSelection() const
 {
-    AccountRecord *pcid = nullptr;
+    const AccountRecord *pcid = nullptr;
     ITEM *item = current_item(menu_);
     if (item != nullptr)
     {
-        pcid = reinterpret_cast<AccountRecord *>(item_userptr(item));
+        pcid = GetAccountRecordFromMenuItem(item);
     }
     return pcid;
 }
@@ -258,61 +260,31 @@ static bool IsGroupMenuItem(const ITEM *item)
 
 void AccountsWin::CreateMenu()
 {
-    menu_items_.clear();
-
     auto &records = app_.GetDb().Records();
-    const char *lastGroup = "";
 
-    ITEM *item;
-    int itemIndex = 0;
-    // Accounts are sorted by group and title
-    for (AccountRecord &record : records)
+    for (const AccountRecord &record : records)
     {
-        const char *group = record.GetField(FT_GROUP, "");
-        if (strcmp(lastGroup, group) != 0)
-        {
-            lastGroup = group;
-
-            // Align groups on column 0
-            while ((itemIndex % NCOLS) != 0)
-            {
-                item = CreateBlankMenuItem();
-                ++itemIndex;
-                menu_items_.push_back(item);
-            }
-
-            // Insert blank row before group, unless group is first menu item
-            if (itemIndex > 0)
-            {
-                for (int i = 0; i < NCOLS; ++i)
-                {
-                    item = CreateBlankMenuItem();
-                    ++itemIndex;
-                    menu_items_.push_back(item);
-                }
-            }
-
-            item = new_item(group, 0);
-            ++itemIndex;
-            menu_items_.push_back(item);
-
-            // Align first account in group on column 0
-            while ((itemIndex % NCOLS) != 0)
-            {
-                item = CreateBlankMenuItem();
-                ++itemIndex;
-                menu_items_.push_back(item);
-            }
-        }
-
         const char *title = record.GetField(FT_TITLE, EMPTY_MENU_ITEM);
         const char *user = record.GetField(FT_USER, EMPTY_MENU_ITEM);
-        item = new_item(title, user);
-        ++itemIndex;
+        ITEM *item = new_item(title, user);
         AssignAccountRecord(item, record);
-        menu_items_.push_back(item);
+        record_items_.push_back(item);
     }
-    menu_items_.push_back(nullptr);
+    for (const AccountRecords::GroupRange &range : records.GroupRanges())
+    {
+        // Accounts without a group come first and have no group heading
+        heading_items_.push_back(range.group == GroupNames::NO_GROUP 
+            ? nullptr : new_item(records.begin()[range.begin].GetField(FT_GROUP), 0));
+    }
+
+    // Positions of the filter are not valid after the records are changed
+    if (filtered_)
+    {
+        filtered_ = false;
+        filter_.clear();
+        SetCommandBar();
+    }
+    LayoutMenu();
 
     menu_ = new_menu(menu_items_.data());
     set_menu_grey(menu_, A_NORMAL);
@@ -331,6 +303,7 @@ void AccountsWin::CreateMenu()
     set_menu_format(menu_, menuWin_nlines, NCOLS);
 
     post_menu(menu_);
+    ShowFilterStatus();
 
     // TESTING repost with 2 cols to see if it works
     // status = unpost_menu(menu);
@@ -338,14 +311,146 @@ void AccountsWin::CreateMenu()
     // status = post_menu(menu);
 }
 
+void AccountsWin::LayoutMenu()
+{
+    menu_items_.clear();
+    group_items_.clear();
+
+    size_t blank_count = 0;
+    auto add_blank_item = [this, &blank_count]() {
+        if (blank_count == blank_items_.size())
+        {
+            blank_items_.push_back(CreateBlankMenuItem());
+        }
+        menu_items_.push_back(blank_items_[blank_count++]);
+    };
+
+    auto &records = app_.GetDb().Records();
+    const std::vector<AccountRecords::GroupRange> &ranges = records.GroupRanges();
+    auto filter_it = filter_.cbegin();
+    // Accounts are sorted by group and title, records of a group are contiguous
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        const AccountRecords::GroupRange &range = ranges[i];
+
+        // Positions in `filter_` of the records of the group that are shown
+        auto first = filter_it, last = filter_it;
+        if (filtered_)
+        {
+            first = std::lower_bound(filter_it, filter_.cend(), range.begin);
+            last = std::lower_bound(first, filter_.cend(), range.end);
+            filter_it = last;
+            if (first == last) continue;
+        }
+
+        if (heading_items_[i])
+        {
+            // Align groups on column 0
+            while ((menu_items_.size() % NCOLS) != 0)
+            {
+                add_blank_item();
+            }
+
+            // Insert blank row before group, unless group is first menu item
+            if (!menu_items_.empty())
+            {
+                for (int col = 0; col < NCOLS; ++col)
+                {
+                    add_blank_item();
+                }
+            }
+
+            group_items_.push_back(menu_items_.size());
+            menu_items_.push_back(heading_items_[i]);
+
+            // Align first account in group on column 0
+            while ((menu_items_.size() % NCOLS) != 0)
+            {
+                add_blank_item();
+            }
+        }
+
+        if (filtered_)
+        {
+            for (auto it = first; it != last; ++it)
+            {
+                menu_items_.push_back(record_items_[*it]);
+            }
+        }
+        else
+        {
+            menu_items_.insert(menu_items_.end(), record_items_.begin() + range.begin, record_items_.begin() + range.end);
+        }
+    }
+    menu_items_.push_back(nullptr);
+}
+
+void AccountsWin::RelayoutMenu()
+{
+    const AccountRecord *selection = GetSelection();
+
+    unpost_menu(menu_);
+    LayoutMenu();
+    // A menu cannot be posted without items
+    const bool empty = menu_items_.size() == 1;
+    set_menu_items(menu_, empty ? nullptr : menu_items_.data());
+    if (empty)
+    {
+        werase(menu_win_);
+    }
+    else
+    {
+        post_menu(menu_);
+        if (selection)
+        {
+            SetSelection(*selection);
+        }
+    }
+    ShowFilterStatus();
+}
+
+void AccountsWin::SetFilter(const std::vector<size_t> &positions)
+{
+    if (filtered_ && filter_ == positions) return;
+    filtered_ = true;
+    filter_ = positions;
+    RelayoutMenu();
+}
+
+void AccountsWin::ClearFilter()
+{
+    if (!filtered_) return;
+    filtered_ = false;
+    filter_.clear();
+    RelayoutMenu();
+}
+
+/** Show the number of records shown by the filter on the first line */
+void AccountsWin::ShowFilterStatus()
+{
+    wmove(win_, /*y*/ 0, /*x*/ 0);
+    wclrtoeol(win_);
+    if (filtered_)
+    {
+        std::string status = filter_.empty() ? std::string("No matching accounts")
+            : std::to_string(filter_.size()).append(filter_.size() == 1 ? " matching account" : " matching accounts");
+        waddstr(win_, status.c_str());
+    }
+}
+
 void AccountsWin::DestroyMenu()
 {
     [[maybe_unused]] int status = unpost_menu(menu_);
     status = free_menu(menu_);
-    for (ITEM *pitem : menu_items_)
+    for (std::vector<ITEM *> *items : {&record_items_, &heading_items_, &blank_items_})
     {
-        if (pitem) status = free_item(pitem);
+        for (ITEM *pitem : *items)
+        {
+            if (pitem) status = free_item(pitem);
+        }
+        items->clear();
     }
+    menu_items_.clear();
 }
 
 // Copied from ui/wxWidgets/MenuEditHandlers.cpp
@@ -462,6 +567,28 @@ static void NavigateLeft(MENU *menu, int /*cols*/, const std::vector<ITEM *> &it
     }
 }
 
+/** Select the heading of the group after the current menu item */
+static void NavigateNextGroup(MENU *menu, const std::vector<ITEM *> &items, const std::vector<int> &group_items)
+{
+    int idx = item_index(current_item(menu));
+    auto it = std::upper_bound(group_items.begin(), group_items.end(), idx);
+    if (it != group_items.end())
+    {
+        set_current_item(menu, items[*it]);
+    }
+}
+
+/** Select the heading of the group before the current menu item */
+static void NavigatePrevGroup(MENU *menu, const std::vector<ITEM *> &items, const std::vector<int> &group_items)
+{
+    int idx = item_index(current_item(menu));
+    auto it = std::lower_bound(group_items.begin(), group_items.end(), idx);
+    if (it != group_items.begin())
+    {
+        set_current_item(menu, items[*(it-1)]);
+    }
+}
+
 static void NavigatePageUp(MENU *menu, int cols, const std::vector<ITEM *> &items)
 {
     menu_driver(menu, REQ_SCR_UPAGE);
@@ -503,30 +630,23 @@ static void NavigatePageDown(MENU *menu, int cols, const std::vector<ITEM *> &it
     }
 }
 
-static bool EqualMenuData(const AccountRecord &a, const AccountRecord &b)
-{
-    return FieldCompare(FT_GROUP, a, b)
-        && FieldCompare(FT_TITLE, a, b)
-        && FieldCompare(FT_USER, a, b);
-}
-
-void AccountsWin::UpdateMenu(ITEM *menu_item, const AccountRecord &old_record, const AccountRecord &new_record)
+void AccountsWin::UpdateMenu(const AccountRecord &old_record, const AccountRecord &new_record)
 {
     AccountRecords &records = app_.GetDb().Records();
-    AccountRecords::iterator it = records.Save(new_record);
-    if (!FieldCompare(FT_UUID, *it, old_record))
+    // `old_record` may be the record in the collection, which is overwritten by Save()
+    const std::string old_uuid = old_record.GetField(FT_UUID, "");
+    AccountRecords::RecordId id = records.Save(new_record);
+    if (old_uuid != records[id].GetField(FT_UUID, ""))
     {
-        AssignAccountRecord(menu_item, *it);
-        records.Delete(old_record);
-    }
-    if (!EqualMenuData(old_record, new_record))
-    {
-        DestroyMenu();
-        CreateMenu();
+        records.Delete(AccountRecord{{FT_UUID, old_uuid}});
     }
 
+    // Menu items reference the record field values, which were replaced
+    DestroyMenu();
+    CreateMenu();
+
     // Reset selection
-    SetSelection(*it);
+    SetSelection(records[id]);
 }
 
 /** View or edit an account entry */
@@ -559,21 +679,13 @@ DialogResult AccountsWin::AddNewEntry()
     if (result == DialogResult::OK)
     {
         const AccountRecord &new_record = details.GetItem();
-        AccountRecords::iterator record_iter = db.Records().Save(new_record);
+        AccountRecords::RecordId id = db.Records().Save(new_record);
 
         DestroyMenu();
         CreateMenu();
 
         // Reset selection
-        const std::string &new_uuid = record_iter->GetField(FT_UUID);
-        auto menu_iter = std::find_if(menu_items_.begin(), menu_items_.end(), [&new_uuid](const ITEM *pitem) { 
-            return item_userptr(pitem) && reinterpret_cast<AccountRecord *>(item_userptr(pitem))->GetField(FT_UUID) == new_uuid; 
-        });
-        assert(menu_iter != menu_items_.end());
-        if (menu_iter != menu_items_.end())
-        {
-            set_current_item(menu_, *menu_iter);
-        }
+        SetSelection(db.Records()[id]);
     }
 
     SetCommandBar();
@@ -586,7 +698,7 @@ DialogResult AccountsWin::DeleteEntry(const ITEM *pitem)
 {
     AccountDb &db = app_.GetDb();
 
-    const AccountRecord *prec = reinterpret_cast<AccountRecord *>(item_userptr(pitem));
+    const AccountRecord *prec = GetAccountRecordFromMenuItem(pitem);
     assert(prec != nullptr);
     if (!prec)
     {
@@ -647,13 +759,12 @@ static bool YesNoCancelKeyHandler(int ch, DialogResult &result)
 /** Save the database to the current file. */
 bool AccountsWin::Save()
 {
-    app_.GetCommandBar().Show({Action::YES, Action::NO, {"^X", "Cancel"}});
-
     bool retval = false;
 
     int rc = RC_FAILURE;
     while (rc != RC_SUCCESS && rc != RC_USER_CANCEL)
     {
+        app_.GetCommandBar().ShowProgress({}, "Saving account database");
         rc = app_.Save();
         if (rc == RC_SUCCESS)
         {
@@ -661,6 +772,8 @@ bool AccountsWin::Save()
         }
         else
         {
+            app_.GetCommandBar().Show({Action::YES, Action::NO, {"^X", "Cancel"}});
+
             AccountDb &db = app_.GetDb();
             std::string msg("An error occurred writing the database to file\n");
             msg.append(db.DbPathname()).append(". Retry?");
@@ -697,6 +810,10 @@ bool AccountsWin::DiscardChanges()
 
         const char *msg = "The database has changed. Discard changes?";
         retval = MessageBox(app_).Show(win_, msg, &YesNoKeyHandler) == DialogResult::YES;
+        if (retval)
+        {
+            app_.GetDb().RemoveJournal();
+        }
 
         redrawwin(win_);
         SetCommandBar();
@@ -733,7 +850,11 @@ DialogResult AccountsWin::Show()
 void AccountsWin::SetCommandBar()
 {
     bool read_only = app_.GetDb().ReadOnly();
-    const unsigned char opts = read_only ? CBOPTS_READONLY : ~CBOPTS_READONLY;
+    int opts = read_only ? CBOPTS_READONLY : CBOPTS_WRITABLE;
+    if (filtered_)
+    {
+        opts |= CBOPTS_FILTERED;
+    }
     app_.GetCommandBar().Show(this, opts);
 }
 
@@ -823,7 +944,7 @@ DialogResult AccountsWin::ProcessInput()
                 const std::string &str = record->GetField(FT_USER);
                 if (CopyTextToClipboard(app_, win_, str) > 0)
                 {
-                    app_.GetCommandBar().Show(this);
+                    SetCommandBar();
                 }
             }
             break;
@@ -837,7 +958,7 @@ DialogResult AccountsWin::ProcessInput()
                 const std::string &str = record->GetField(FT_PASSWORD);
                 if (CopyTextToClipboard(app_, win_, str) > 0)
                 {
-                    app_.GetCommandBar().Show(this);
+                    SetCommandBar();
                 }
             }
             break;
@@ -846,7 +967,16 @@ DialogResult AccountsWin::ProcessInput()
         {
             using std::placeholders::_1;
             app_.DoSearch();
-            app_.GetCommandBar().Show(this);
+            SetCommandBar();
+            break;
+        }
+        case KEY_ESC:
+        {
+            if (filtered_)
+            {
+                ClearFilter();
+                SetCommandBar();
+            }
             break;
         }
         case '\n':
@@ -864,7 +994,7 @@ DialogResult AccountsWin::ProcessInput()
                 AccountRecord copy{*record};
                 if (ShowAccountRecord(copy) == DialogResult::OK && !read_only)
                 {
-                    UpdateMenu(item, *record, copy);
+                    UpdateMenu(*record, copy);
                 }
             }
 
@@ -919,9 +1049,27 @@ DialogResult AccountsWin::ProcessInput()
             break;
         }
 
+        case '\t':
+        {
+            NavigateNextGroup(menu_, menu_items_, group_items_);
+            break;
+        }
+
+        case KEY_BTAB:
+        {
+            NavigatePrevGroup(menu_, menu_items_, group_items_);
+            break;
+        }
+
         default:
             break;
         }
+
+        if (!read_only)
+        {
+            // Keep changes recoverable until they are saved
+            app_.GetDb().WriteJournal();
+        }
     }
 
 done:
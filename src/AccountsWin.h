@@ -4,6 +4,7 @@
 #include "libncurses.h"
 #include "Dialog.h"
 #include "AccountRecord.h"
+#include <vector>
 #include <set>
 
 class PWSafeApp;
@@ -19,9 +20,28 @@ public:
     void SetSelection(const AccountRecord &cid) const;
     const AccountRecord *GetSelection() const;
 
+    /**
+     * Show only the records at `positions` and the headings of their groups.
+     * \param positions Positions in sort order of the records, ascending
+     */
+    void SetFilter(const std::vector<size_t> &positions);
+    /** Show all records */
+    void ClearFilter();
+    bool IsFiltered() const
+    {
+        return filtered_;
+    }
+    /** Returns `true` if the filter shows no records */
+    bool IsFilterEmpty() const
+    {
+        return filtered_ && filter_.empty();
+    }
+
 private:
-    /* Command bar display mask */
+    /* Command bar display masks */
     static constexpr int CBOPTS_READONLY = 1;
+    static constexpr int CBOPTS_WRITABLE = 2;
+    static constexpr int CBOPTS_FILTERED = 4;
     /** Number of columns in which accounts will be displayed */
     static constexpr int NCOLS = 2;
 
@@ -30,14 +50,14 @@ private:
      * The AccountRecord must be const because `set` doesn't allow 
      * modifying keys
      */
-    static AccountRecord *GetAccountRecordFromMenuItem(const ITEM *menu_item)
+    static const AccountRecord *GetAccountRecordFromMenuItem(const ITEM *menu_item)
     {
-        return reinterpret_cast<AccountRecord *>(item_userptr(menu_item));
+        return reinterpret_cast<const AccountRecord *>(item_userptr(menu_item));
     }
 
-    static void AssignAccountRecord(ITEM *menu_item, AccountRecord &record)
+    static void AssignAccountRecord(ITEM *menu_item, const AccountRecord &record)
     {
-        set_item_userptr(menu_item, reinterpret_cast<void *>(&record));
+        set_item_userptr(menu_item, const_cast<void *>(reinterpret_cast<const void *>(&record)));
     }
 
     /** Save changes to database */
@@ -47,7 +67,7 @@ private:
     /** View or edit an account entry */
     DialogResult ShowAccountRecord(AccountRecord &itemData);
     /** Replace a menu entry */
-    void UpdateMenu(ITEM *menu_item, const AccountRecord &old_record, const AccountRecord &new_record);
+    void UpdateMenu(const AccountRecord &old_record, const AccountRecord &new_record);
     /** Add a new account entry */
     DialogResult AddNewEntry();
     /** Delete an account entry */
@@ -63,6 +83,11 @@ private:
     void CreateMenuDataItems();
     void CreateMenu();
     void DestroyMenu();
+    /** Select the menu items shown for the current filter into `menu_items_` */
+    void LayoutMenu();
+    /** Show the menu items for a changed filter, keeping the selection if it is shown */
+    void RelayoutMenu();
+    void ShowFilterStatus();
     void SetCommandBar();
     DialogResult ProcessInput();
 
@@ -73,7 +98,22 @@ private:
     WINDOW *menu_win_ = nullptr;
     MENU *menu_ = nullptr;
     PANEL *panel_ = nullptr;
+    /** Menu items shown, null-terminated */
     std::vector<ITEM *> menu_items_;
+    /** Indexes in `menu_items_` of the group headings, ascending */
+    std::vector<int> group_items_;
+    /** 
+     * Menu items of the records, by position in sort order.
+     * Items are created for all records, the filter selects the items shown.
+     */
+    std::vector<ITEM *> record_items_;
+    /** Menu items of the group headings, by index in `AccountRecords::GroupRanges()`, `nullptr` for no group */
+    std::vector<ITEM *> heading_items_;
+    /** Blank menu items used to align groups, reused when the filter changes */
+    std::vector<ITEM *> blank_items_;
+    /** Positions in sort order of the records shown if `filtered_` */
+    std::vector<size_t> filter_;
+    bool filtered_ = false;
     int save_cursor_ = 0;
 };
 
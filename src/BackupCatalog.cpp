@@ -0,0 +1,184 @@
+/* Copyright 2023 Ian Boisvert */
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <set>
+
+#include "BackupCatalog.h"
+#include "Filesystem.h"
+
+/** Length of the timestamp in a backup file name: `-YYYYMMdd_HHmmss` */
+static constexpr size_t TIMESTAMP_LEN = 16;
+
+std::filesystem::path BackupCatalog::BackupPathname(const std::filesystem::path &db_path, time_t time)
+{
+    struct tm tm;
+    localtime_r(&time, &tm);
+
+    constexpr size_t buflen = 128;
+    char buf[buflen];
+    snprintf(buf, buflen, "-%04d%02d%02d_%02d%02d%02d", 
+        tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);  // -YYYYMMdd_HHmmss
+
+    std::string backup_filename = db_path.stem().string() + buf + db_path.extension().string();
+    return db_path.parent_path() / backup_filename;
+}
+
+bool BackupCatalog::ParseBackupPathname(const std::filesystem::path &db_path, 
+    const std::filesystem::path &pathname, time_t &time)
+{
+    const std::string stem = db_path.stem().string(), ext = db_path.extension().string();
+    const std::string filename = pathname.filename().string();
+    if (filename.size() != stem.size() + TIMESTAMP_LEN + ext.size()
+        || filename.compare(0, stem.size(), stem) != 0
+        || filename.compare(filename.size() - ext.size(), ext.size(), ext) != 0)
+    {
+        return false;
+    }
+
+    struct tm tm = {};
+    int n = 0;
+    const char *timestamp = filename.c_str() + stem.size();
+    if (sscanf(timestamp, "-%4d%2d%2d_%2d%2d%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, 
+            &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &n) != 6 || n != (int)TIMESTAMP_LEN)
+    {
+        return false;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time = mktime(&tm);
+    return time != (time_t)-1;
+}
+
+void BackupCatalog::Load(const std::filesystem::path &db_path)
+{
+    if (db_path == db_path_)
+    {
+        return;
+    }
+
+    db_path_ = db_path;
+    backups_.clear();
+    for (const std::filesystem::path &pathname : filesystem_.ListDirectory(db_path.parent_path()))
+    {
+        time_t time;
+        if (ParseBackupPathname(db_path, pathname, time))
+        {
+            backups_.push_back(Backup{pathname, time});
+        }
+    }
+    std::sort(backups_.begin(), backups_.end(), [](const Backup &a, const Backup &b) {
+        return a.time < b.time || (a.time == b.time && a.pathname < b.pathname);
+    });
+}
+
+void BackupCatalog::Add(const std::filesystem::path &pathname, time_t time)
+{
+    backups_.erase(std::remove_if(backups_.begin(), backups_.end(), 
+        [&pathname](const Backup &backup) { return backup.pathname == pathname; }), 
+        backups_.end());
+    auto pos = std::upper_bound(backups_.begin(), backups_.end(), time, 
+        [](time_t t, const Backup &backup) { return t < backup.time; });
+    backups_.insert(pos, Backup{pathname, time});
+}
+
+void BackupCatalog::Add(const std::filesystem::path &pathname, time_t time, uint64_t hash)
+{
+    Add(pathname, time);
+    for (Backup &backup : backups_)
+    {
+        if (backup.pathname == pathname)
+        {
+            backup.hash = hash;
+            backup.has_hash = true;
+        }
+    }
+}
+
+bool BackupCatalog::IsLatest(uint64_t hash)
+{
+    if (backups_.empty())
+    {
+        return false;
+    }
+    Backup &latest = backups_.back();
+    if (!filesystem_.Exists(latest.pathname))
+    {
+        return false;
+    }
+    if (!latest.has_hash)
+    {
+        std::error_code ec;
+        latest.hash = filesystem_.HashFile(latest.pathname, ec);
+        if (ec)
+        {
+            return false;
+        }
+        latest.has_hash = true;
+    }
+    return latest.hash == hash;
+}
+
+/** Number of days from 1970-01-01 to the date `year`-`mon`-`mday` of the proleptic Gregorian calendar */
+static int64_t DaysFromCivil(int64_t year, unsigned mon, unsigned mday)
+{
+    year -= mon <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(year - era * 400);
+    const unsigned doy = (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5 + mday - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+/**
+ * Keep the `retention.recent` most recent backups, then for each tier
+ * keep the most recent backup in each of the `count` most recent periods
+ * that have a backup. Periods are local calendar hours, days and weeks 
+ * starting on Monday.
+ */
+std::vector<BackupCatalog::Backup> BackupCatalog::Expire(const Retention &retention)
+{
+    enum { HOURLY, DAILY, WEEKLY, TIERS };
+    const size_t counts[TIERS] = {retention.hourly, retention.daily, retention.weekly};
+
+    const size_t len = backups_.size();
+    // Period of each backup in each tier
+    std::vector<std::array<int64_t, TIERS>> periods(len);
+    for (size_t i = 0; i < len; ++i)
+    {
+        struct tm tm;
+        localtime_r(&backups_[i].time, &tm);
+        const int64_t day = DaysFromCivil(tm.tm_year + 1900LL, tm.tm_mon + 1, tm.tm_mday);
+        periods[i][HOURLY] = day * 24 + tm.tm_hour;
+        periods[i][DAILY] = day;
+        // 1970-01-01 was a Thursday
+        periods[i][WEEKLY] = (day + 3 >= 0 ? day + 3 : day - 3) / 7;
+    }
+
+    std::vector<bool> keep(len, false);
+    // Most recent backups are at the end
+    for (size_t i = 0; i < len && i < retention.recent; ++i)
+    {
+        keep[len - 1 - i] = true;
+    }
+    for (int tier = 0; tier < TIERS; ++tier)
+    {
+        std::set<int64_t> seen;
+        for (size_t i = len; i-- > 0 && seen.size() < counts[tier]; )
+        {
+            if (seen.insert(periods[i][tier]).second)
+            {
+                keep[i] = true;
+            }
+        }
+    }
+
+    std::vector<Backup> expired, kept;
+    for (size_t i = 0; i < len; ++i)
+    {
+        (keep[i] ? kept : expired).push_back(std::move(backups_[i]));
+    }
+    backups_ = std::move(kept);
+    return expired;
+}
@@ -0,0 +1,99 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_BACKUPCATALOG_H
+#define HAVE_BACKUPCATALOG_H
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+struct Filesystem;
+
+/**
+ * Backup files of an account database.
+ *
+ * Backups are found by scanning the directory of the account database once
+ * for files named `<stem>-YYYYMMdd_HHmmss<extension>`, then the catalog is
+ * updated as backups are added and expired.
+ */
+class BackupCatalog
+{
+public:
+    struct Backup
+    {
+        std::filesystem::path pathname;
+        /** Time the backup was created, from the file name */
+        time_t time;
+        /** Hash of the file contents, see `Filesystem::HashFile()`, valid if `has_hash` */
+        uint64_t hash = 0;
+        bool has_hash = false;
+    };
+
+    /** 
+     * Number of backups to keep in each tier. 
+     * The most recent backup in each period of a tier is kept.
+     */
+    struct Retention
+    {
+        /** Most recent backups kept regardless of age */
+        size_t recent = 0;
+        size_t hourly = 0;
+        size_t daily = 0;
+        size_t weekly = 0;
+    };
+
+    explicit BackupCatalog(const Filesystem &filesystem) : filesystem_(filesystem) 
+    { }
+
+    /** 
+     * Returns the pathname of the backup of account database `db_path` created at `time`.
+     * `db_path` must be a canonical path.
+     */
+    static std::filesystem::path BackupPathname(const std::filesystem::path &db_path, time_t time);
+
+    /** 
+     * If `pathname` is a backup of account database `db_path`, 
+     * set `time` to the time the backup was created and return `true`.
+     */
+    static bool ParseBackupPathname(const std::filesystem::path &db_path, 
+        const std::filesystem::path &pathname, time_t &time);
+
+    /** 
+     * Scan the directory of account database `db_path` for backups,
+     * unless the catalog has already been loaded for `db_path`.
+     */
+    void Load(const std::filesystem::path &db_path);
+
+    /** Add a backup, replacing a backup with the same pathname */
+    void Add(const std::filesystem::path &pathname, time_t time);
+    /** Add a backup with contents that have hash `hash` */
+    void Add(const std::filesystem::path &pathname, time_t time, uint64_t hash);
+
+    /** 
+     * Returns `true` if the most recent backup exists and its contents 
+     * have hash `hash`. The hash of a backup found by Load() is computed
+     * the first time it is needed.
+     */
+    bool IsLatest(uint64_t hash);
+
+    /** 
+     * Remove the backups that are not kept by `retention` from the catalog
+     * and return them, so the caller can delete the files.
+     */
+    std::vector<Backup> Expire(const Retention &retention);
+
+    /** Backups ordered from oldest to most recent */
+    const std::vector<Backup> &Backups() const
+    {
+        return backups_;
+    }
+
+private:
+    const Filesystem &filesystem_;
+    /** Account database of the backups, empty if not loaded */
+    std::filesystem::path db_path_;
+    std::vector<Backup> backups_;
+};
+
+#endif
@@ -21,12 +21,8 @@ int ChangeDbPasswordCommand::Execute()
 
     app_.BackupDb();
 
+    // Reading the database validates the password
     int rc;
-    if (!db.CheckPassword(&rc))
-    {
-        return rc;
-    }
-
     if (db.ReadDb(&rc))
     {
         db.Password() = new_password_;
@@ -21,7 +21,8 @@ bool ChangeDbPasswordDlg::ValidateForm(const Dialog &dialog)
 {
     WINDOW *win = dialog.GetParentWindow();
     AccountDb &db = app_.GetDb();
-    if (!db.CheckPassword(dialog.GetValue(FT_PASSWORD)))
+    // The database was opened with Password(), no need to derive the key again
+    if (dialog.GetValue(FT_PASSWORD) != db.Password())
     {
         const char *msg = "Account database password is incorrect";
         MessageBox(app_).Show(win, msg);
@@ -0,0 +1,72 @@
+/* Copyright 2023 Ian Boisvert */
+#include <memory>
+#include "Collation.h"
+#include "libicu.h"
+#ifdef HAVE_GLOG
+#include "libglog.h"
+#endif
+
+/** Collator for the default locale, shared by all threads to be cloned */
+static const icu::Collator *GetCollator()
+{
+    static const std::unique_ptr<icu::Collator> collator = []() {
+        UErrorCode status = U_ZERO_ERROR;
+        std::unique_ptr<icu::Collator> collator{icu::Collator::createInstance(status)};
+        if (U_FAILURE(status))
+        {
+#if HAVE_GLOG
+            LOG(ERROR) << "Failed to create collator: " << u_errorName(status);
+#endif
+            collator.reset();
+        }
+        return collator;
+    }();
+    return collator.get();
+}
+
+void AppendSortKey(const char *str, std::string &key)
+{
+    if (!str) str = "";
+
+    // Collators are not thread-safe, each thread uses its own clone
+    thread_local std::unique_ptr<icu::Collator> collator{GetCollator() ? GetCollator()->clone() : nullptr};
+    if (!collator)
+    {
+        key.append(str).push_back('\0');
+        return;
+    }
+
+    icu::UnicodeString ustr = icu::UnicodeString::fromUTF8(str);
+    size_t offset = key.size();
+    key.resize(offset + 2 * ustr.length() + 16);
+    int32_t len = collator->getSortKey(ustr, reinterpret_cast<uint8_t *>(&key[offset]), 
+        static_cast<int32_t>(key.size() - offset));
+    if (static_cast<size_t>(len) > key.size() - offset)
+    {
+        // Buffer was too small, len is the required size
+        key.resize(offset + len);
+        len = collator->getSortKey(ustr, reinterpret_cast<uint8_t *>(&key[offset]), len);
+    }
+    key.resize(offset + len);
+}
+
+void AppendFoldedText(const char *str, std::string &text)
+{
+    if (!str || !*str) return;
+
+    icu::UnicodeString ustr = icu::UnicodeString::fromUTF8(str);
+    ustr.foldCase(U_FOLD_CASE_DEFAULT);
+
+    // Case folding can produce text that is not in NFC
+    UErrorCode status = U_ZERO_ERROR;
+    const icu::Normalizer2 *nfc = icu::Normalizer2::getNFCInstance(status);
+    if (U_SUCCESS(status) && !nfc->isNormalized(ustr, status) && U_SUCCESS(status))
+    {
+        icu::UnicodeString normalized = nfc->normalize(ustr, status);
+        if (U_SUCCESS(status))
+        {
+            ustr = std::move(normalized);
+        }
+    }
+    ustr.toUTF8String(text);
+}
@@ -0,0 +1,30 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_COLLATION_H
+#define HAVE_COLLATION_H
+
+#include <string>
+
+/**
+ * Append the collation sort key of UTF-8 string `str` to `key`.
+ *
+ * Sort keys are generated by the ICU collator for the default locale.
+ * Each key ends with a 0 byte and contains no other 0 byte, so keys 
+ * of several strings can be appended and the result compared as 
+ * a single key with `memcmp()` or `std::string::compare()`.
+ * If the collator cannot be created, the key is the bytes of `str`,
+ * which sorts the same as `strcmp()`.
+ * This function is thread-safe.
+ */
+void AppendSortKey(const char *str, std::string &key);
+
+/**
+ * Append UTF-8 string `str` to `text`, case-folded and NFC-normalized.
+ *
+ * Strings are folded with full Unicode case folding, so a folded query
+ * can be matched against folded text with a byte-wise substring search.
+ * If the string cannot be normalized, the folded string is appended as is.
+ * This function is thread-safe.
+ */
+void AppendFoldedText(const char *str, std::string &text);
+
+#endif  //#ifndef HAVE_COLLATION_H
@@ -18,6 +18,15 @@ void CommandBarWin::Show(std::vector<Action> actions)
     CommandBarWin::ShowActions(app_, win_, actions, /*opts*/ (int)-1);
 }
 
+void CommandBarWin::ShowProgress(std::vector<Action> actions, const std::string &status)
+{
+    static const char SPINNER[] = {'|', '/', '-', '\\'};
+
+    std::string spinner(1, SPINNER[progress_frame_++ % sizeof(SPINNER)]);
+    actions.emplace_back(spinner, status);
+    Show(actions);
+}
+
 static const char *STATUS_READ_ONLY = "RO";
 
 void CommandBarWin::ShowActions(const PWSafeApp &app, WINDOW *win, const std::vector<Action> &actions, int opts)
@@ -63,6 +63,13 @@ public:
     /** Update the command bar with the give actions */
     void Show(std::vector<Action> actions);
 
+    /** 
+     * Update the command bar with the given actions followed by `status`,
+     * prefixed with a spinner that advances each time this is called.
+     * Used to show progress of a long-running task.
+     */
+    void ShowProgress(std::vector<Action> actions, const std::string &status);
+
     // Generate help screen from list of actions
     // void ShowHelp()
 
@@ -72,6 +79,7 @@ private:
     std::map<void *, std::vector<Action>> actions_;
     PWSafeApp &app_;
     WINDOW *win_ = nullptr;
+    size_t progress_frame_ = 0;
 };
 
 #endif
\ No newline at end of file
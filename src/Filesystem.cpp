@@ -1,4 +1,86 @@
 /* Copyright 2023 Ian Boisvert */
+#include "config.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+
 #include "Filesystem.h"
 
-Filesystem Filesystem::instance;
\ No newline at end of file
+Filesystem Filesystem::instance;
+
+uint64_t fs::HashFile(const std::filesystem::path &pathname, std::error_code &ec)
+{
+    static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL, FNV_PRIME = 1099511628211ULL;
+
+    ec.clear();
+    int fd = open(pathname.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        ec.assign(errno, std::generic_category());
+        return 0;
+    }
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    unsigned char buf[64 * 1024];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t i = 0; i < len; ++i)
+        {
+            hash = (hash ^ buf[i]) * FNV_PRIME;
+        }
+    }
+    if (len < 0)
+    {
+        ec.assign(errno, std::generic_category());
+    }
+    close(fd);
+    return hash;
+}
+
+bool fs::Reflink(const std::filesystem::path &src, const std::filesystem::path &dst, std::error_code &ec)
+{
+#ifdef FICLONE
+    ec.clear();
+    int src_fd = open(src.c_str(), O_RDONLY);
+    if (src_fd < 0)
+    {
+        ec.assign(errno, std::generic_category());
+        return false;
+    }
+    int dst_fd = open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (dst_fd < 0)
+    {
+        ec.assign(errno, std::generic_category());
+        close(src_fd);
+        return false;
+    }
+    if (ioctl(dst_fd, FICLONE, src_fd) != 0)
+    {
+        ec.assign(errno, std::generic_category());
+    }
+    else if (struct stat st; fstat(src_fd, &st) == 0)
+    {
+        fchmod(dst_fd, st.st_mode & 07777);
+    }
+    close(src_fd);
+    close(dst_fd);
+    if (ec)
+    {
+        unlink(dst.c_str());
+        return false;
+    }
+    return true;
+#else
+    (void)src;
+    (void)dst;
+    ec = std::make_error_code(std::errc::operation_not_supported);
+    return false;
+#endif
+}
@@ -2,7 +2,9 @@
 #ifndef HAVE_FILESYSTEM_H
 #define HAVE_FILESYSTEM_H
 
+#include <cstdint>
 #include <filesystem>
+#include <vector>
 
 namespace fs
 {
@@ -18,10 +20,37 @@ inline void Copy(const std::filesystem::path &src, const std::filesystem::path &
 {
     std::filesystem::copy(src, dst);
 }
+inline void CreateHardLink(const std::filesystem::path &src, const std::filesystem::path &dst)
+{
+    std::filesystem::create_hard_link(src, dst);
+}
+/** 
+ * Copy `src` to a new file `dst` that shares the data blocks of `src` 
+ * until either file is modified. Only some file systems support this, 
+ * e.g. btrfs and XFS.
+ * \returns `false` and sets `ec` if the file system does not support it
+ */
+bool Reflink(const std::filesystem::path &src, const std::filesystem::path &dst, std::error_code &ec);
+/** 
+ * Returns a 64-bit FNV-1a hash of the contents of the file at `pathname`.
+ * Sets `ec` if the file cannot be read.
+ */
+uint64_t HashFile(const std::filesystem::path &pathname, std::error_code &ec);
 inline bool Exists(const std::filesystem::path &pathname)
 {
     return std::filesystem::exists(pathname);
 }
+/** Pathnames of the regular files in directory `dir`, empty if `dir` cannot be read */
+inline std::vector<std::filesystem::path> ListDirectory(const std::filesystem::path &dir)
+{
+    std::vector<std::filesystem::path> pathnames;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec))
+    {
+        if (entry.is_regular_file(ec)) pathnames.push_back(entry.path());
+    }
+    return pathnames;
+}
 inline uintmax_t FileSize(const std::filesystem::path &pathname)
 {
     return std::filesystem::file_size(pathname);
@@ -49,10 +78,26 @@ struct Filesystem
     {
         fs::Copy(src, dst);
     }
+    virtual void CreateHardLink(const std::filesystem::path &src, const std::filesystem::path &dst) const
+    {
+        fs::CreateHardLink(src, dst);
+    }
+    virtual bool Reflink(const std::filesystem::path &src, const std::filesystem::path &dst, std::error_code &ec) const
+    {
+        return fs::Reflink(src, dst, ec);
+    }
+    virtual uint64_t HashFile(const std::filesystem::path &pathname, std::error_code &ec) const
+    {
+        return fs::HashFile(pathname, ec);
+    }
     virtual bool Exists(const std::filesystem::path &pathname) const
     {
         return fs::Exists(pathname);
     }
+    virtual std::vector<std::filesystem::path> ListDirectory(const std::filesystem::path &dir) const
+    {
+        return fs::ListDirectory(dir);
+    }
     virtual uintmax_t FileSize(const std::filesystem::path &pathname) const
     {
         return fs::FileSize(pathname);
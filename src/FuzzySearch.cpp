@@ -0,0 +1,198 @@
+/* Copyright 2023 Ian Boisvert */
+#include <algorithm>
+#include <iterator>
+#include "FuzzySearch.h"
+#include "libicu.h"
+
+// Score of each matched character
+static constexpr int SCORE_MATCH = 16;
+// Bonus for a character at the start of a word or field
+static constexpr int BONUS_BOUNDARY = 8;
+// Bonus for a character following a matched character
+static constexpr int BONUS_CONSECUTIVE = 4;
+// Multiplier of the bonus of the first character of the query
+static constexpr int BONUS_FIRST_CHAR_MULTIPLIER = 2;
+// Penalties for the first and subsequent unmatched characters of a gap
+static constexpr int PENALTY_GAP_START = 3;
+static constexpr int PENALTY_GAP_EXTENSION = 1;
+// Penalty for each field separator in a match
+static constexpr int PENALTY_FIELD_SPAN = 16;
+
+static bool IsWordChar(UChar32 c)
+{
+    return c >= 0x80 || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+/** Code points of `str` excluding spaces */
+static std::vector<UChar32> DecodeQuery(const std::string &str)
+{
+    std::vector<UChar32> query;
+    const auto *s = reinterpret_cast<const uint8_t *>(str.data());
+    for (int32_t i = 0, len = static_cast<int32_t>(str.size()); i < len;)
+    {
+        UChar32 c;
+        U8_NEXT(s, i, len, c);
+        if (c > 0 && c != ' ') query.push_back(c);
+    }
+    return query;
+}
+
+/**
+ * Find the shortest match of `query` ending at the first position where the
+ * text contains all of its characters in order, then score the characters of
+ * the match from left to right.
+ */
+static bool ScoreImpl(const std::string &text, const std::vector<UChar32> &query, int &score)
+{
+    const auto *s = reinterpret_cast<const uint8_t *>(text.data());
+    const int32_t len = static_cast<int32_t>(text.size());
+    const size_t qlen = query.size();
+    if (qlen == 0) return false;
+
+    // First position where all characters have been matched
+    int32_t end = -1;
+    size_t qi = 0;
+    for (int32_t i = 0; i < len;)
+    {
+        UChar32 c;
+        U8_NEXT(s, i, len, c);
+        if (c == query[qi] && ++qi == qlen)
+        {
+            end = i;
+            break;
+        }
+    }
+    if (end < 0) return false;
+
+    // Last position from which all characters can be matched before `end`
+    int32_t start = end;
+    for (qi = qlen; qi > 0;)
+    {
+        UChar32 c;
+        U8_PREV(s, 0, start, c);
+        if (c == query[qi-1]) --qi;
+    }
+
+    UChar32 prev = 0;
+    if (start > 0)
+    {
+        int32_t i = start;
+        U8_PREV(s, 0, i, prev);
+    }
+    score = 0;
+    int consecutive = 0;
+    bool in_gap = false;
+    qi = 0;
+    for (int32_t i = start; i < end;)
+    {
+        UChar32 c;
+        U8_NEXT(s, i, end, c);
+        if (qi < qlen && c == query[qi])
+        {
+            // The start of a field is a word start only for the first character,
+            // characters following a field separator are not a continuation of the match
+            bool boundary = prev == 0 ? qi == 0 : !IsWordChar(prev);
+            int bonus = boundary && IsWordChar(c) ? BONUS_BOUNDARY : 0;
+            if (consecutive > 0) bonus = std::max(bonus, BONUS_CONSECUTIVE);
+            if (qi == 0) bonus *= BONUS_FIRST_CHAR_MULTIPLIER;
+            score += SCORE_MATCH + bonus;
+            ++consecutive;
+            in_gap = false;
+            ++qi;
+        }
+        else if (c == 0)
+        {
+            score -= PENALTY_FIELD_SPAN;
+            consecutive = 0;
+            in_gap = true;
+        }
+        else
+        {
+            score -= in_gap ? PENALTY_GAP_EXTENSION : PENALTY_GAP_START;
+            consecutive = 0;
+            in_gap = true;
+        }
+        prev = c;
+    }
+    return true;
+}
+
+uint64_t FuzzySearch::CharMask(const std::string &folded_text)
+{
+    uint64_t mask = 0;
+    const auto *s = reinterpret_cast<const uint8_t *>(folded_text.data());
+    for (int32_t i = 0, len = static_cast<int32_t>(folded_text.size()); i < len;)
+    {
+        UChar32 c;
+        U8_NEXT(s, i, len, c);
+        int bit;
+        if (c <= 0 || c == ' ') continue;
+        else if (c >= 'a' && c <= 'z') bit = c - 'a';
+        else if (c >= '0' && c <= '9') bit = 26 + (c - '0');
+        else if (c < 0x80) bit = 36 + c % 8;
+        else bit = 44 + c % 20;
+        mask |= uint64_t{1} << bit;
+    }
+    return mask;
+}
+
+bool FuzzySearch::Score(const std::string &folded_text, const std::string &folded_query, int &score)
+{
+    return ScoreImpl(folded_text, DecodeQuery(folded_query), score);
+}
+
+const FuzzySearch::Matches &FuzzySearch::Search(AccountRecords &records, const std::string &folded_query)
+{
+    std::string query;
+    std::remove_copy(folded_query.begin(), folded_query.end(), std::back_inserter(query), ' ');
+
+    // A record that matches a query matches every prefix of the query,
+    // so only the matches of a prefix need to be scored
+    bool narrow = records_ == &records && change_seq_ == records.ChangeSeq()
+        && !query_.empty() && query.compare(0, query_.size(), query_) == 0;
+    if (narrow && query == query_)
+    {
+        return matches_;
+    }
+    records_ = &records;
+    change_seq_ = records.ChangeSeq();
+    query_ = query;
+
+    const std::vector<UChar32> decoded = DecodeQuery(query);
+    if (decoded.empty())
+    {
+        matches_.clear();
+        return matches_;
+    }
+    const uint64_t query_mask = CharMask(query);
+    auto begin = records.begin();
+    Matches matches;
+    auto score_record = [&](size_t pos) {
+        const AccountRecord &rec = begin[pos];
+        int score;
+        if ((rec.FuzzyMask() & query_mask) == query_mask && ScoreImpl(rec.FuzzyText(), decoded, score))
+        {
+            matches.push_back({pos, score});
+        }
+    };
+    if (narrow)
+    {
+        for (const Match &match : matches_)
+        {
+            score_record(match.pos);
+        }
+    }
+    else
+    {
+        for (size_t pos = 0, len = records.size(); pos < len; ++pos)
+        {
+            score_record(pos);
+        }
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const Match &a, const Match &b) {
+        return a.score != b.score ? a.score > b.score : a.pos < b.pos;
+    });
+    matches_.swap(matches);
+    return matches_;
+}
@@ -0,0 +1,73 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_FUZZYSEARCH_H
+#define HAVE_FUZZYSEARCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AccountRecords.h"
+
+/**
+ * Fuzzy search of the group, title, user and URL of records.
+ *
+ * A record matches if the characters of the query, ignoring spaces,
+ * appear in order in its folded fuzzy text, see `AccountRecord::FuzzyText()`.
+ * Matches are scored by the characters matched, with bonuses for characters
+ * at the start of a word and for consecutive characters, and penalties for
+ * gaps, then ranked best first. A match may span fields, each field separator
+ * in the match is penalized and breaks the bonuses.
+ *
+ * Records are first checked with a mask of the characters in their text,
+ * so most records that do not match are rejected without being scored.
+ */
+class FuzzySearch
+{
+public:
+    struct Match
+    {
+        /** Position in sort order of the record */
+        size_t pos;
+        int score;
+    };
+    typedef std::vector<Match> Matches;
+
+    /**
+     * Mask of the characters in folded UTF-8 text.
+     * Each character sets one bit, so text having all the characters
+     * of a query has all the bits of the mask of the query.
+     */
+    static uint64_t CharMask(const std::string &folded_text);
+
+    /**
+     * Score the match of `folded_query` in `folded_text`.
+     * The match is the shortest one ending where the leftmost match of all
+     * the characters of the query ends, it is not necessarily the match
+     * with the highest score.
+     * \returns `false` if the characters of the query are not in the text in order
+     */
+    static bool Score(const std::string &folded_text, const std::string &folded_query, int &score);
+
+    /**
+     * Find the records matching `folded_query`, best match first.
+     * Records with equal scores are in sort order.
+     * The returned matches are valid until the next call.
+     */
+    const Matches &Search(AccountRecords &records, const std::string &folded_query);
+
+    void Clear()
+    {
+        query_.clear();
+        matches_.clear();
+        records_ = nullptr;
+    }
+
+private:
+    /** Query of `matches_`, without spaces */
+    std::string query_;
+    Matches matches_;
+    const AccountRecords *records_ = nullptr;
+    /** Value of `AccountRecords::ChangeSeq()` when `matches_` was found */
+    uint64_t change_seq_ = 0;
+};
+
+#endif  //#ifndef HAVE_FUZZYSEARCH_H
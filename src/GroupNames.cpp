@@ -0,0 +1,30 @@
+/* Copyright 2023 Ian Boisvert */
+#include "GroupNames.h"
+#include "Collation.h"
+
+GroupNames GroupNames::instance_;
+
+const GroupNames::Entry &GroupNames::Intern(const char *name)
+{
+    if (!name || !*name)
+    {
+        return Empty();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = index_.find(name); it != index_.end())
+    {
+        return entries_[it->second];
+    }
+    Id id = static_cast<Id>(entries_.size());
+    const Entry &entry = entries_.emplace_back(Entry{name, id, MakeSortKey(name)});
+    index_.emplace(entry.name, id);
+    return entry;
+}
+
+std::string GroupNames::MakeSortKey(const char *name)
+{
+    std::string key;
+    AppendSortKey(name, key);
+    return key;
+}
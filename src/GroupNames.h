@@ -0,0 +1,74 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_GROUPNAMES_H
+#define HAVE_GROUPNAMES_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * Table of interned account group names.
+ *
+ * Many records share a few groups, so records refer to
+ * an entry in this table instead of storing a copy of the group name.
+ * Entries are never removed, references to entries remain valid
+ * for the lifetime of the program.
+ */
+class GroupNames
+{
+public:
+    typedef uint32_t Id;
+
+    struct Entry
+    {
+        std::string name;
+        Id id;
+        /** Collation sort key of `name`, see `AppendSortKey()` */
+        std::string sort_key;
+    };
+
+    /** ID of the empty group name, i.e. records that are not in a group */
+    static constexpr Id NO_GROUP = 0;
+
+    /** Singleton */
+    static GroupNames &Instance()
+    {
+        return instance_;
+    }
+
+    /** 
+     * Returns the entry for group `name`, adding it if required.
+     * A `null` or empty name returns the entry for `NO_GROUP`.
+     * This function is thread-safe.
+     */
+    const Entry &Intern(const char *name);
+
+    /** Entry for `NO_GROUP` */
+    const Entry &Empty() const
+    {
+        return *empty_;
+    }
+
+private:
+    GroupNames()
+    {
+        empty_ = &entries_.emplace_back(Entry{"", NO_GROUP, MakeSortKey("")});
+        index_.emplace(empty_->name, NO_GROUP);
+    }
+
+    static std::string MakeSortKey(const char *name);
+
+    static GroupNames instance_;
+
+    std::mutex mutex_;
+    /** Elements of a deque are not moved when it grows */
+    std::deque<Entry> entries_;
+    /** Entry ID by name, keys refer to `Entry::name` */
+    std::unordered_map<std::string_view, Id> index_;
+    const Entry *empty_;
+};
+
+#endif  //#ifndef HAVE_GROUPNAMES_H
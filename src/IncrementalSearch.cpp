@@ -0,0 +1,49 @@
+/* Copyright 2023 Ian Boisvert */
+#include <algorithm>
+#include "IncrementalSearch.h"
+
+const IncrementalSearch::Matches &IncrementalSearch::Search(AccountRecords &records, const std::string &folded_query)
+{
+    if (records_ != &records || change_seq_ != records.ChangeSeq())
+    {
+        // Positions of the matches are not valid after the records are changed
+        results_.clear();
+        records_ = &records;
+        change_seq_ = records.ChangeSeq();
+    }
+
+    // A text that contains the query contains every prefix of the query,
+    // so the matches of the longest prefix on the stack are the candidates
+    while (!results_.empty() && folded_query.compare(0, results_.back().folded_query.size(), results_.back().folded_query) != 0)
+    {
+        results_.pop_back();
+    }
+    if (!results_.empty() && results_.back().folded_query == folded_query)
+    {
+        return results_.back().matches;
+    }
+
+    Result result{folded_query, {}};
+    if (results_.empty())
+    {
+        result.matches = records.FindMatches(folded_query);
+    }
+    else
+    {
+        auto begin = records.begin();
+        for (size_t pos : results_.back().matches)
+        {
+            if (begin[pos].SearchTextContains(folded_query))
+            {
+                result.matches.push_back(pos);
+            }
+        }
+    }
+
+    if (results_.size() == MAX_DEPTH)
+    {
+        results_.erase(results_.begin());
+    }
+    results_.push_back(std::move(result));
+    return results_.back().matches;
+}
@@ -0,0 +1,58 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_INCREMENTALSEARCH_H
+#define HAVE_INCREMENTALSEARCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AccountRecords.h"
+
+/**
+ * Matches of a query that is changed one character at a time.
+ *
+ * The matches of each query are kept on a stack. When a character is
+ * appended to the query, only the matches of the previous query are searched.
+ * When a character is deleted, the matches of the shorter query are
+ * popped from the stack.
+ * The stack is cleared when the records are changed.
+ */
+class IncrementalSearch
+{
+public:
+    /** Positions in sort order of the matching records, ascending */
+    typedef std::vector<size_t> Matches;
+
+    /** Maximum number of queries on the stack, the oldest are dropped */
+    static constexpr size_t MAX_DEPTH = 32;
+
+    /**
+     * Find the records whose search text contains `folded_query`,
+     * see `AccountRecord::SearchTextContains()`.
+     * The returned matches are valid until the next call.
+     */
+    const Matches &Search(AccountRecords &records, const std::string &folded_query);
+
+    void Clear()
+    {
+        results_.clear();
+        records_ = nullptr;
+    }
+
+private:
+    struct Result
+    {
+        std::string folded_query;
+        Matches matches;
+    };
+
+    std::vector<Result> results_;
+    const AccountRecords *records_ = nullptr;
+    /** Value of `AccountRecords::ChangeSeq()` when the stack was built */
+    uint64_t change_seq_ = 0;
+
+#ifdef FRIEND_TEST
+    FRIEND_TEST(AccountRecordsTest, TestIncrementalSearch);
+#endif
+};
+
+#endif  //#ifndef HAVE_INCREMENTALSEARCH_H
@@ -0,0 +1,381 @@
+/* Copyright 2023 Ian Boisvert */
+#include "config.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_RANDOM_H
+#include <sys/random.h>
+#endif
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "libnettle.h"
+#include "Journal.h"
+#include "Filesystem.h"
+#include "ResultCode.h"
+
+static constexpr char MAGIC[8] = {'N', 'C', 'P', 'W', 'S', 'J', '0', '1'};
+static constexpr uint32_t KDF_ITERATIONS = 100000;
+static constexpr size_t NONCE_LEN = 12;
+static constexpr size_t TAG_LEN = GCM_DIGEST_SIZE;
+
+static void PutUint32(std::vector<uint8_t> &buf, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) buf.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+static uint32_t GetUint32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void PutUint64(uint8_t *p, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) p[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+static uint64_t GetUint64(const uint8_t *p)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) value = (value << 8) | p[i];
+    return value;
+}
+
+/** Fill `buf` with random bytes from the kernel CSPRNG, returns `false` on failure */
+static bool RandomBytes(uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+#ifdef HAVE_SYS_RANDOM_H
+    while (pos < len)
+    {
+        ssize_t n = getrandom(buf + pos, len - pos, 0);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+        pos += n;
+    }
+    if (pos == len) return true;
+#endif
+
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    while (pos < len)
+    {
+        ssize_t n = read(fd, buf + pos, len - pos);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        pos += n;
+    }
+    close(fd);
+    return pos == len;
+}
+
+/** Start encrypting or decrypting entry `index` of the journal with header `header` */
+static void InitGcm(gcm_aes256_ctx &ctx, const uint8_t *key, const uint8_t *header, size_t header_len, 
+    uint32_t index, const uint8_t *nonce)
+{
+    gcm_aes256_set_key(&ctx, key);
+    gcm_aes256_set_iv(&ctx, NONCE_LEN, nonce);
+    std::vector<uint8_t> ad(header, header + header_len);
+    PutUint32(ad, index);
+    gcm_aes256_update(&ctx, ad.size(), ad.data());
+}
+
+/** Serialize `entry`: op (1), UUID (16), then if `SAVE` field count (1) and fields: type (1), length (4), value */
+static std::vector<uint8_t> SerializeEntry(const Journal::Entry &entry)
+{
+    std::vector<uint8_t> buf;
+    buf.push_back(static_cast<uint8_t>(entry.op));
+    buf.insert(buf.end(), entry.uuid.bytes.begin(), entry.uuid.bytes.end());
+    if (entry.op == Journal::Op::SAVE)
+    {
+        size_t count_pos = buf.size();
+        buf.push_back(0);
+        for (uint8_t field_type : AccountRecord::FIELD_TYPES)
+        {
+            if (const char *value = entry.record.GetField(field_type))
+            {
+                size_t len = strlen(value);
+                buf.push_back(field_type);
+                PutUint32(buf, static_cast<uint32_t>(len));
+                buf.insert(buf.end(), value, value + len);
+                ++buf[count_pos];
+            }
+        }
+    }
+    return buf;
+}
+
+/** Returns `false` if `buf` is not a serialized entry */
+static bool DeserializeEntry(const std::vector<uint8_t> &buf, Journal::Entry &entry)
+{
+    const size_t len = buf.size();
+    if (len < 1 + 16) return false;
+    entry.op = static_cast<Journal::Op>(buf[0]);
+    memcpy(entry.uuid.bytes.data(), &buf[1], 16);
+    entry.record = AccountRecord();
+    if (entry.op == Journal::Op::DELETE)
+    {
+        return len == 1 + 16;
+    }
+    if (entry.op != Journal::Op::SAVE || len < 1 + 16 + 1)
+    {
+        return false;
+    }
+    size_t pos = 1 + 16 + 1;
+    for (uint8_t i = 0, count = buf[1 + 16]; i < count; ++i)
+    {
+        if (len - pos < 1 + 4) return false;
+        uint8_t field_type = buf[pos];
+        uint32_t field_len = GetUint32(&buf[pos + 1]);
+        pos += 1 + 4;
+        // Field types from another version are not supported
+        if (std::find(AccountRecord::FIELD_TYPES.begin(), AccountRecord::FIELD_TYPES.end(), field_type) 
+            == AccountRecord::FIELD_TYPES.end())
+        {
+            return false;
+        }
+        if (len - pos < field_len) return false;
+        std::string value(reinterpret_cast<const char *>(&buf[pos]), field_len);
+        entry.record.SetField(field_type, value.c_str());
+        pos += field_len;
+    }
+    return pos == len;
+}
+
+Journal::~Journal()
+{
+    Close();
+}
+
+void Journal::Close()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+    index_ = 0;
+}
+
+Journal::Key Journal::DeriveKey(const std::string &password, const uint8_t *salt, uint32_t iterations)
+{
+    Key key;
+    pbkdf2_hmac_sha256(password.size(), reinterpret_cast<const uint8_t *>(password.data()), 
+        iterations, SALT_LEN, salt, key.size(), key.data());
+    return key;
+}
+
+bool Journal::EncryptEntry(const Key &key, const Header &header, uint32_t index, 
+    const Entry &entry, std::vector<uint8_t> &buf)
+{
+    uint8_t nonce[NONCE_LEN];
+    if (!RandomBytes(nonce, NONCE_LEN))
+    {
+        return false;
+    }
+    std::vector<uint8_t> plaintext = SerializeEntry(entry);
+
+    PutUint32(buf, static_cast<uint32_t>(plaintext.size()));
+    buf.insert(buf.end(), nonce, nonce + NONCE_LEN);
+    size_t pos = buf.size();
+    buf.resize(pos + plaintext.size() + TAG_LEN);
+
+    gcm_aes256_ctx ctx;
+    InitGcm(ctx, key.data(), header.data(), header.size(), index, nonce);
+    gcm_aes256_encrypt(&ctx, plaintext.size(), &buf[pos], plaintext.data());
+    gcm_aes256_digest(&ctx, TAG_LEN, &buf[pos + plaintext.size()]);
+
+    std::fill(plaintext.begin(), plaintext.end(), 0);
+    return true;
+}
+
+bool Journal::WriteAll(int fd, const std::vector<uint8_t> &buf)
+{
+    size_t pos = 0;
+    while (pos < buf.size())
+    {
+        ssize_t n = write(fd, buf.data() + pos, buf.size() - pos);
+        if (n < 0) return false;
+        pos += n;
+    }
+    return fdatasync(fd) == 0;
+}
+
+bool Journal::DeriveSecret(const std::string &password, Secret &secret)
+{
+    if (!RandomBytes(secret.salt.data(), SALT_LEN))
+    {
+        return false;
+    }
+    secret.key = DeriveKey(password, secret.salt.data(), KDF_ITERATIONS);
+    secret.password = password;
+    return true;
+}
+
+void Journal::SetSecret(const Secret &secret)
+{
+    // The header of an open journal must not change
+    Close();
+    memcpy(header_.data(), MAGIC, sizeof(MAGIC));
+    memcpy(&header_[8], secret.salt.data(), SALT_LEN);
+    std::vector<uint8_t> iterations;
+    PutUint32(iterations, KDF_ITERATIONS);
+    memcpy(&header_[8 + SALT_LEN], iterations.data(), 4);
+    key_ = secret.key;
+    key_password_ = secret.password;
+    has_key_ = true;
+}
+
+bool Journal::Create(const std::string &pathname, const std::string &password, uint64_t db_hash, 
+    const std::vector<Entry> &entries, int *rc)
+{
+    Close();
+
+    if (!has_key_ || key_password_ != password)
+    {
+        Secret secret;
+        if (!DeriveSecret(password, secret))
+        {
+            has_key_ = false;
+            SetResultCode(rc, RC_FAILURE);
+            return false;
+        }
+        SetSecret(secret);
+    }
+    PutUint64(&header_[8 + SALT_LEN + 4], db_hash);
+
+    std::vector<uint8_t> buf(header_.begin(), header_.end());
+    uint32_t index = 0;
+    for (const Entry &entry : entries)
+    {
+        if (!EncryptEntry(key_, header_, index++, entry, buf))
+        {
+            SetResultCode(rc, RC_FAILURE);
+            return false;
+        }
+    }
+
+    std::string tmp_pathname = pathname + ".XXXXXX";
+    int fd = mkstemp(tmp_pathname.data());
+    if (fd < 0)
+    {
+        SetResultCode(rc, RC_ERR_CANT_OPEN_FILE);
+        return false;
+    }
+    if (!WriteAll(fd, buf) || rename(tmp_pathname.c_str(), pathname.c_str()) != 0)
+    {
+        close(fd);
+        unlink(tmp_pathname.c_str());
+        SetResultCode(rc, RC_FAILURE);
+        return false;
+    }
+
+    fd_ = fd;
+    size_ = buf.size();
+    index_ = index;
+    SetResultCode(rc, RC_SUCCESS);
+    return true;
+}
+
+bool Journal::Append(const std::vector<Entry> &entries, int *rc)
+{
+    if (fd_ < 0)
+    {
+        SetResultCode(rc, RC_ERR_INVALID_ARG);
+        return false;
+    }
+
+    std::vector<uint8_t> buf;
+    uint32_t index = index_;
+    for (const Entry &entry : entries)
+    {
+        if (!EncryptEntry(key_, header_, index++, entry, buf))
+        {
+            // Nothing was written, the journal is still valid
+            SetResultCode(rc, RC_FAILURE);
+            return false;
+        }
+    }
+    if (!WriteAll(fd_, buf))
+    {
+        // The journal may end with an incomplete entry, start a new journal next time
+        Close();
+        SetResultCode(rc, RC_FAILURE);
+        return false;
+    }
+    size_ += buf.size();
+    index_ = index;
+    SetResultCode(rc, RC_SUCCESS);
+    return true;
+}
+
+bool Journal::Read(const std::string &pathname, const std::string &password, uint64_t &db_hash, 
+    std::vector<Entry> &entries, int *rc)
+{
+    std::ifstream is(pathname, std::ios::binary);
+    if (!is)
+    {
+        SetResultCode(rc, fs::Exists(pathname) ? RC_ERR_CANT_OPEN_FILE : RC_ERR_FILE_DOESNT_EXIST);
+        return false;
+    }
+    std::vector<uint8_t> buf{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+
+    if (buf.size() < HEADER_LEN || memcmp(buf.data(), MAGIC, sizeof(MAGIC)) != 0)
+    {
+        SetResultCode(rc, RC_ERR_CORRUPT_DB);
+        return false;
+    }
+    const uint8_t *header = buf.data();
+    // The header is not authenticated until an entry is decrypted,
+    // a corrupt iteration count must not abort or hang the key derivation
+    uint32_t iterations = GetUint32(&header[8 + SALT_LEN]);
+    if (iterations != KDF_ITERATIONS)
+    {
+        SetResultCode(rc, RC_ERR_CORRUPT_DB);
+        return false;
+    }
+    db_hash = GetUint64(&header[8 + SALT_LEN + 4]);
+    Key key = DeriveKey(password, &header[8], iterations);
+
+    entries.clear();
+    size_t pos = HEADER_LEN;
+    for (uint32_t index = 0; buf.size() - pos >= 4 + NONCE_LEN + TAG_LEN; ++index)
+    {
+        size_t len = GetUint32(&buf[pos]);
+        if (buf.size() - pos - 4 - NONCE_LEN - TAG_LEN < len)
+        {
+            break;  // Incomplete entry
+        }
+        const uint8_t *nonce = &buf[pos + 4];
+        const uint8_t *ciphertext = nonce + NONCE_LEN;
+
+        std::vector<uint8_t> plaintext(len);
+        uint8_t tag[TAG_LEN];
+        gcm_aes256_ctx ctx;
+        InitGcm(ctx, key.data(), header, HEADER_LEN, index, nonce);
+        gcm_aes256_decrypt(&ctx, len, plaintext.data(), ciphertext);
+        gcm_aes256_digest(&ctx, TAG_LEN, tag);
+
+        Entry entry;
+        if (!memeql_sec(tag, ciphertext + len, TAG_LEN) || !DeserializeEntry(plaintext, entry))
+        {
+            SetResultCode(rc, RC_ERR_CORRUPT_DB);
+            return false;
+        }
+        std::fill(plaintext.begin(), plaintext.end(), 0);
+        entries.push_back(std::move(entry));
+        pos += 4 + NONCE_LEN + len + TAG_LEN;
+    }
+
+    SetResultCode(rc, RC_SUCCESS);
+    return true;
+}
@@ -0,0 +1,142 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_JOURNAL_H
+#define HAVE_JOURNAL_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AccountRecord.h"
+#include "Uuid.h"
+
+/**
+ * Encrypted, append-only journal of changes to account records that have
+ * not been saved to the account database, to recover the changes after a crash.
+ *
+ * File format, integers are little-endian:
+ * - Header: magic `NCPWSJ01` (8), salt (16), KDF iterations (4), 
+ *   hash of the account database file (8), see `Filesystem::HashFile()`
+ * - Entries: ciphertext length (4), nonce (12), ciphertext, tag (16)
+ *
+ * Entries are encrypted with AES-256-GCM using a key derived from the
+ * account database password with PBKDF2-HMAC-SHA256. The header and
+ * the index of the entry are authenticated with each entry, so entries
+ * cannot be modified, reordered or copied to another journal.
+ */
+class Journal
+{
+public:
+    enum class Op : uint8_t
+    {
+        SAVE = 1,
+        DELETE = 2
+    };
+
+    struct Entry
+    {
+        Op op;
+        Uuid uuid;
+        /** The saved record, empty if `op` is `DELETE` */
+        AccountRecord record;
+    };
+
+    static constexpr size_t SALT_LEN = 16;
+    static constexpr size_t KEY_LEN = 32;
+
+    /** Journal key derived from an account database password and a random salt */
+    struct Secret
+    {
+        std::string password;
+        std::array<uint8_t, SALT_LEN> salt;
+        std::array<uint8_t, KEY_LEN> key;
+    };
+
+    /** Returns the pathname of the journal of the account database at `db_pathname` */
+    static std::string Pathname(const std::string &db_pathname)
+    {
+        return db_pathname + ".journal";
+    }
+
+    Journal() = default;
+    ~Journal();
+
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    /** Returns `true` if the journal is open for appending */
+    bool IsOpen() const
+    {
+        return fd_ >= 0;
+    }
+
+    /** Size of the journal file in bytes */
+    size_t Size() const
+    {
+        return size_;
+    }
+
+    /** 
+     * Derive a journal key from `password` with a new salt. 
+     * This is slow, so it is done when the database is unlocked, see SetSecret().
+     * \returns `false` if no salt could be generated
+     */
+    static bool DeriveSecret(const std::string &password, Secret &secret);
+
+    /** 
+     * Use `secret` for the journals created while the password is `secret.password`.
+     * Closes the journal, the next journal is created with the new key.
+     */
+    void SetSecret(const Secret &secret);
+
+    /** 
+     * Write a new journal containing `entries` to a temporary file, 
+     * then rename it over the file at `pathname`, and keep it open for appending.
+     * The key is derived again only if `password` changed since the last call.
+     */
+    bool Create(const std::string &pathname, const std::string &password, uint64_t db_hash, 
+        const std::vector<Entry> &entries, int *rc = nullptr);
+
+    /** Append `entries` to the open journal and flush it to storage */
+    bool Append(const std::vector<Entry> &entries, int *rc = nullptr);
+
+    /** Close the journal file */
+    void Close();
+
+    /** 
+     * Read the entries of the journal at `pathname`. 
+     * An incomplete entry at the end of the file, left by a crash 
+     * while the entry was written, is ignored.
+     * \returns `RC_ERR_FILE_DOESNT_EXIST` if there is no journal,
+     *   `RC_ERR_CORRUPT_DB` if the journal is not valid, or if it was not 
+     *   written with `password`
+     */
+    static bool Read(const std::string &pathname, const std::string &password, uint64_t &db_hash, 
+        std::vector<Entry> &entries, int *rc = nullptr);
+
+private:
+    static constexpr size_t HEADER_LEN = 8 + SALT_LEN + 4 + 8;
+
+    typedef std::array<uint8_t, KEY_LEN> Key;
+    typedef std::array<uint8_t, HEADER_LEN> Header;
+
+    /** Derive the journal key from `password` */
+    static Key DeriveKey(const std::string &password, const uint8_t *salt, uint32_t iterations);
+    /** Encrypt `entry` and append it to `buf`, returns `false` if no nonce could be generated */
+    static bool EncryptEntry(const Key &key, const Header &header, uint32_t index, 
+        const Entry &entry, std::vector<uint8_t> &buf);
+    /** Write all of `buf` to `fd` and flush it to storage */
+    static bool WriteAll(int fd, const std::vector<uint8_t> &buf);
+
+    int fd_ = -1;
+    size_t size_ = 0;
+    /** Index of the next entry */
+    uint32_t index_ = 0;
+    Header header_{};
+    Key key_{};
+    /** Password used to derive `key_`, the salt in `header_` is reused while it does not change */
+    std::string key_password_;
+    bool has_key_ = false;
+};
+
+#endif  //#ifndef HAVE_JOURNAL_H
@@ -7,6 +7,7 @@
 #endif
 
 #include "AccountsWin.h"
+#include "BackupCatalog.h"
 #include "Dialog.h"
 #include "Label.h"
 #include "MessageBox.h"
@@ -23,8 +24,34 @@ void PWSafeApp::Init(ProgArgs args)
 
     prefs_.ReadPrefs(args_.config_file_);
 
+    // Backups were tracked in preferences "backup.0"..."backup.127", 
+    // they are now found by scanning the database directory
+    if (prefs_.HasPref("backup.0"))
+    {
+        char key[32];
+        for (size_t nbackup = 0; nbackup < 128; ++nbackup)
+        {
+            snprintf(key, 32, "backup.%zu", nbackup);
+            prefs_.Delete(key);
+        }
+    }
+
     db_.ReadOnly() = args.read_only_;
 
+    std::string durability = prefs_.GetPrefValue<std::string>(Prefs::SAVE_DURABILITY);
+    if (durability == "none")
+    {
+        db_.SaveDurability() = AccountDb::Durability::NONE;
+    }
+    else if (durability == "directory")
+    {
+        db_.SaveDurability() = AccountDb::Durability::DIRECTORY;
+    }
+    else
+    {
+        db_.SaveDurability() = AccountDb::Durability::FILE;
+    }
+
     // Get progname
     std::string prog_name = args.prog_name_;
     int pos = prog_name.rfind(L'/');
@@ -76,23 +103,16 @@ DialogResult PWSafeApp::Show()
             db_.DbPathname() = db_pathname;
             db_.Password() = password;
 
-            if (db_.CheckPassword())
+            // The database was read when the password was validated
+            // Save the database file that was opened
+            prefs_.Set(Prefs::DB_PATHNAME, db_pathname);
+
+            db_.ClearDirty();
+            if (!db_.ReadOnly() && db_.HasJournal())
             {
-                if (db_.ReadDb())
-                {
-                    // Save the database file that was opened
-                    prefs_.Set(Prefs::DB_PATHNAME, db_pathname);
-
-                    db_.ClearDirty();
-                    dr = accountswin_->Show();
-                }
-                else
-                {
-                    std::string msg("An error occurred reading database file ");
-                    msg.append(db_pathname.c_str());
-                    MessageBox(*this).Show(win_, msg.c_str());
-                }
+                RecoverJournal();
             }
+            dr = accountswin_->Show();
         }
     }
 
@@ -101,6 +121,25 @@ DialogResult PWSafeApp::Show()
     return dr;
 }
 
+/** Ask to recover the unsaved changes in the journal of the database */
+void PWSafeApp::RecoverJournal()
+{
+    commandbarwin_->Show(CommandBarWin::YES_NO);
+    const char *msg = "Unsaved changes to the account database were found. Recover them?";
+    if (MessageBox(*this).Show(win_, msg, &YesNoKeyHandler) == DialogResult::YES)
+    {
+        if (!db_.ReplayJournal())
+        {
+            MessageBox(*this).Show(win_, "The unsaved changes could not be recovered.");
+            db_.RemoveJournal();
+        }
+    }
+    else
+    {
+        db_.RemoveJournal();
+    }
+}
+
 /**
  * Save the database.
  * Backup the database first if enabled in preferences
@@ -204,90 +243,65 @@ ResultCode PWSafeApp::BackupDb()
     return status;
 }
 
-typedef std::vector<std::pair<std::string, std::string>> backup_list_t;
-
-/**
- * Returns an iterator at which expired backup files should be removed.
- * Backups are assumed to be in order of decreasing age--
- * the last entry in the list was the most recent backup
-*/
-static backup_list_t::iterator FilterBackups(backup_list_t &backups, size_t backup_count)
+/** Returns the value of preference `key` as a count, negative values are `0` */
+static size_t GetCountPref(Prefs &prefs, const char *key)
 {
-    backup_list_t::iterator retval = backups.end();
-    if (backups.size() > backup_count)
-    {
-        // Swap the most recent backups at the end of the list 
-        // with the items at the beginning
-        for (backup_list_t::iterator src = backups.end()-backup_count, dst = backups.begin(); src != backups.end(); ++src, ++dst)
-        {
-            swap(*dst, *src);
-        }
-        retval = backups.begin() + backup_count;
-    }
-    return retval;
+    long lval = prefs.GetPrefValue<long>(key);
+    return lval > 0 ? lval : 0;
 }
 
-// Must be > 0. If Prefs::BACKUP_COUNT >= MAX_BACKUPS, 
-// then eventually backups will stop being tracked
-static constexpr size_t MAX_BACKUPS = 128;
-
-// IMB 2023-08-27 This function seems much more complicated than it should be
+/** Remove the backups that are not kept by the retention preferences */
 void PWSafeApp::CleanBackups()
 {
-    namespace fs = std::filesystem;
-
-    char key[32];
-    long lval = prefs_.GetPrefValue<long>(Prefs::BACKUP_COUNT);
-    size_t backup_count = lval > 0 ? lval : 0;
-
-    backup_list_t backups;
+    BackupCatalog::Retention retention;
+    retention.recent = GetCountPref(prefs_, Prefs::BACKUP_COUNT);
+    retention.hourly = GetCountPref(prefs_, Prefs::BACKUP_KEEP_HOURLY);
+    retention.daily = GetCountPref(prefs_, Prefs::BACKUP_KEEP_DAILY);
+    retention.weekly = GetCountPref(prefs_, Prefs::BACKUP_KEEP_WEEKLY);
 
-    // Check that backup files saved in prefs actually exist
-    size_t nbackup = 0;
-    for ( ; nbackup < MAX_BACKUPS; ++nbackup)
+    for (const BackupCatalog::Backup &backup : backups_.Expire(retention))
     {
-        snprintf(key, 32, "backup.%zu", nbackup);
-        if (!prefs_.HasPref(key)) break;
-
-        std::string pathname = prefs_.GetPrefValue<std::string>(key);
-        if (fs::file_status fs = fs::status(pathname); fs.type() != fs::file_type::regular)
-        {
-            // File doesn't exist or isn't a regular file -> disown
-            prefs_.Delete(key);
-        }
-        else
-        {
-            backups.emplace_back(key, pathname);
-        }
-
+        std::error_code ec;
+        filesystem_.Remove(backup.pathname, ec);
+#if HAVE_GLOG
+        LOG_IF(WARNING, ec) << "Error deleting backup file \"" << backup.pathname << "\": " << ec.message();
+#endif
     }
+}
 
-    // Filter the list of backups, 
-    // after function call `pos` points to the start of backups to delete
-    backup_list_t::iterator pos = FilterBackups(backups, backup_count);
+/** 
+ * Create backup file `dst` of account database `src` 
+ * using the strategy in preference `Prefs::BACKUP_STRATEGY`.
+ * Falls back to copying `src` if the strategy is not supported.
+ */
+void PWSafeApp::CreateBackupFile(const std::filesystem::path &src, const std::filesystem::path &dst)
+{
+    namespace fs = std::filesystem;
 
-    // First handle deletions because when preferences are updated, the keys will be modified
-    for (backup_list_t::iterator it = pos; it != backups.end(); ++it)
+    std::string strategy = prefs_.GetPrefValue<std::string>(Prefs::BACKUP_STRATEGY);
+    if (strategy == "reflink")
     {
         std::error_code ec;
-        filesystem_.Remove(it->second, ec);
+        if (filesystem_.Reflink(src, dst, ec)) return;
 #if HAVE_GLOG
-        LOG_IF(WARNING, ec) << "Error deleting backup file \"" << it->second << "\": " << ec.message();
+        LOG(INFO) << "Cannot reflink account database file \"" << src << "\", copying: " << ec.message();
 #endif
     }
-
-    const size_t len = pos - backups.begin();
-    for (nbackup = 0; nbackup != len; ++nbackup)
-    {
-        snprintf(key, 32, "backup.%zu", nbackup);
-        prefs_.Set(key, backups[nbackup].second);
-    }
-
-    for ( ; nbackup < MAX_BACKUPS; ++nbackup)
+    else if (strategy == "link")
     {
-        snprintf(key, 32, "backup.%zu", nbackup);
-        prefs_.Delete(key);
+        try
+        {
+            filesystem_.CreateHardLink(src, dst);
+            return;
+        }
+        catch (fs::filesystem_error &cause)
+        {
+#if HAVE_GLOG
+            LOG(INFO) << "Cannot link account database file \"" << src << "\", copying: " << cause.what();
+#endif
+        }
     }
+    filesystem_.Copy(src, dst);
 }
 
 /** Backup the current account database */
@@ -301,36 +315,26 @@ ResultCode PWSafeApp::BackupDbImpl()
     ResultCode status = RC_SUCCESS;
 
     fs::path db_path(filesystem_.Canonical(db));
-    fs::path filename = db_path.filename();
-
-    time_t now = time(nullptr);
-    struct tm tm;
-    localtime_r(&now, &tm);
+    backups_.Load(db_path);
 
-    constexpr size_t buflen = 128;
-    char buf[buflen];
-    snprintf(buf, buflen, "-%04d%02d%02d_%02d%02d%02d", 
-        tm.tm_year+1900, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);  // -YYYYMMdd_HHmmss.bak
+    // Skip the backup if the database has not changed since the last backup
+    std::error_code ec;
+    uint64_t hash = filesystem_.HashFile(db_path, ec);
+    if (!ec && backups_.IsLatest(hash))
+    {
+#if HAVE_GLOG
+        LOG(INFO) << "Account database file \"" << db_path << "\" has not changed since the last backup";
+#endif
+        return status;
+    }
 
-    std::string backup_filename = db_path.stem().string() + buf + db_path.extension().string();
-    fs::path backup = db_path.parent_path() / backup_filename;
+    time_t now = time(nullptr);
+    fs::path backup = BackupCatalog::BackupPathname(db_path, now);  // -YYYYMMdd_HHmmss
     
     if (filesystem_.Exists(backup))
     {
         // IMB 2023-08-27 I don't think preserving an existing backup 
         // with identical timestamp is the right answer--overwrite and log
-        // // Backup backup
-        // fs::path backup2(backup);
-        // backup2 += ".2";
-        // try
-        // {
-        //     filesystem_.Copy(backup, backup2);
-        // }
-        // catch (fs::filesystem_error &cause)
-        // {
-        //     // TODO IMB 2023-07-01 log error copying backup file
-        // }
-        // backup += ".1";
 #if HAVE_GLOG
         LOG(WARNING) << "A backup file with pathname \"" << backup << "\" already exists. Overwriting.";
 #endif        
@@ -338,34 +342,15 @@ ResultCode PWSafeApp::BackupDbImpl()
 
     try
     {
-        filesystem_.Copy(db_path, backup);
-
-        // Append backup file pathname to prefs
-        char key[32];
-        size_t nbackup = 0;
-        for ( ; nbackup < MAX_BACKUPS; ++nbackup)
+        CreateBackupFile(db_path, backup);
+        if (ec)
         {
-            snprintf(key, 32, "backup.%zu", nbackup);
-            if (!prefs_.HasPref(key))
-            {
-                std::error_code ec;
-                backup = filesystem_.Canonical(backup, ec);  // Ignore errors
-                if (ec)
-                {
-#if HAVE_GLOG
-                    LOG(WARNING) << "Error converting to canonical path \"" << backup.c_str() << "\": " << ec.message();
-#endif                    
-                }
-                prefs_.Set(key, backup.string());
-                break;
-            }
+            backups_.Add(backup, now);
+        }
+        else
+        {
+            backups_.Add(backup, now, hash);
         }
-#if HAVE_GLOG
-        long lval = prefs_.GetPrefValue<long>(Prefs::BACKUP_COUNT);
-        size_t backup_count = lval > 0 ? lval : 0;
-        LOG_IF(INFO, nbackup == MAX_BACKUPS) << "Too many account database backup files stored in preferences (" << MAX_BACKUPS << ")";
-        LOG_IF(WARNING, backup_count >= MAX_BACKUPS) << "Preference \"backup-count\" is set too high (" << backup_count << "), it should be less than (" << MAX_BACKUPS << ")";
-#endif        
     }
     catch (fs::filesystem_error &cause)
     {
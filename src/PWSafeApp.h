@@ -7,6 +7,7 @@
 
 #include "AccountDb.h"
 #include "AccountsWin.h"
+#include "BackupCatalog.h"
 #include "CommandBarWin.h"
 #include "ProgArgs.h"
 #include "ResultCode.h"
@@ -23,7 +24,8 @@ public:
 
     PWSafeApp(Filesystem &filesystem = Filesystem::instance) : 
         prefs_(Prefs::Instance()),
-        filesystem_(filesystem)
+        filesystem_(filesystem),
+        backups_(filesystem)
     { }
 
     // SUPPORT FUNCTIONS
@@ -78,13 +80,17 @@ private:
     void EndTUI();
     void ProcessInput();
 
+    void RecoverJournal();
     ResultCode BackupDbImpl();
+    void CreateBackupFile(const std::filesystem::path &src, const std::filesystem::path &dst);
     void CleanBackups();
 
     Prefs &prefs_;
     ProgArgs args_;
     AccountDb db_;
     Filesystem &filesystem_;
+    /** Backups of the account database, loaded by the first backup */
+    BackupCatalog backups_;
     std::unique_ptr<AccountsWin> accountswin_;
     std::unique_ptr<CommandBarWin> commandbarwin_;
 
@@ -98,5 +104,9 @@ private:
 #ifdef FRIEND_TEST
     FRIEND_TEST(AppTest, TestBackupDb_DstDoesntExist);
     FRIEND_TEST(AppTest, TestBackupDb_DstDoesExist);
+    FRIEND_TEST(AppTest, TestBackupDb_ReflinkFallsBackToCopy);
+    FRIEND_TEST(AppTest, TestBackupDb_Link);
+    FRIEND_TEST(AppTest, TestCleanBackups);
+    FRIEND_TEST(AppTest, TestBackupDb_SkipsUnchanged);
 #endif
 };
@@ -0,0 +1,43 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_PARALLEL_H
+#define HAVE_PARALLEL_H
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+ * Call `fn(begin, end)` for the chunks of the range `[0, len)`,
+ * each chunk on a separate thread, and wait for all the threads.
+ * Chunk `i` of `n` is `[len * i / n, len * (i + 1) / n)`.
+ * If `nthreads` is less than 2 or `len` is less than `min_size`,
+ * `fn(0, len)` is called on the calling thread.
+ * \param nthreads Number of threads, if `0` the number of hardware threads is used
+ * \returns The number of chunks
+ */
+template <class Fn>
+unsigned ParallelFor(size_t len, unsigned nthreads, size_t min_size, Fn fn)
+{
+    if (nthreads == 0)
+    {
+        nthreads = std::thread::hardware_concurrency();
+    }
+    if (nthreads < 2 || len < min_size)
+    {
+        fn(size_t{0}, len);
+        return 1;
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < nthreads; ++i)
+    {
+        threads.emplace_back(fn, len * i / nthreads, len * (i + 1) / nthreads);
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    return nthreads;
+}
+
+#endif  //#ifndef HAVE_PARALLEL_H
@@ -0,0 +1,49 @@
+/* Copyright 2023 Ian Boisvert */
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "PrefetchDbTask.h"
+#include "Filesystem.h"
+
+PrefetchDbTask::PrefetchDbTask(const std::string &db_pathname)
+    : db_pathname_(db_pathname), state_(std::make_shared<State>())
+{
+    thread_ = std::thread([state = state_, db_pathname]() {
+        static const size_t BUFFER_SIZE = 64 * 1024;
+
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(db_pathname, ec);
+        std::ifstream is(db_pathname, std::ios::binary);
+        if (ec || !is)
+        {
+            // Let libpwsafe report the error
+            state->done = true;
+            return;
+        }
+
+        // Only the ciphertext is read, nothing needs to be protected
+        std::vector<char> buf(BUFFER_SIZE);
+        is.read(buf.data(), buf.size());
+        state->invalid = !IsValidHeader(buf.data(), is.gcount(), size);
+        while (is)
+        {
+            is.read(buf.data(), buf.size());
+        }
+        state->done = true;
+    });
+}
+
+PrefetchDbTask::~PrefetchDbTask()
+{
+    // Do not wait for a slow file system, the worker thread only uses shared state
+    if (thread_.joinable())
+    {
+        thread_.detach();
+    }
+}
+
+bool PrefetchDbTask::IsValidHeader(const char *header, size_t len, uintmax_t size)
+{
+    return len >= 4 && memcmp(header, "PWS3", 4) == 0 && size >= HEADER_SIZE + TRAILER_SIZE;
+}
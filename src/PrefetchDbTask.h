@@ -0,0 +1,65 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_PREFETCHDBTASK_H
+#define HAVE_PREFETCHDBTASK_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+/** 
+ * Reads an account database file on a worker thread so the file is
+ * in the OS page cache when libpwsafe reads it, and checks the file header.
+ */
+class PrefetchDbTask
+{
+public:
+    /** Size of the psafe3 header: tag, salt, iterations, H(P'), B1-B4, IV */
+    static const size_t HEADER_SIZE = 4 + 32 + 4 + 32 + 64 + 16;
+    /** Size of the psafe3 trailer: EOF block, HMAC */
+    static const size_t TRAILER_SIZE = 16 + 32;
+
+    explicit PrefetchDbTask(const std::string &db_pathname);
+    ~PrefetchDbTask();
+
+    PrefetchDbTask(const PrefetchDbTask &) = delete;
+    PrefetchDbTask &operator=(const PrefetchDbTask &) = delete;
+
+    const std::string &DbPathname() const
+    {
+        return db_pathname_;
+    }
+
+    /** Returns `true` when the worker thread has finished reading the file */
+    bool IsDone() const
+    {
+        return state_->done;
+    }
+
+    /** 
+     * Returns `true` if the file was read and it is not a psafe3 database.
+     * Returns `false` if the read did not complete.
+     */
+    bool IsInvalid() const
+    {
+        return state_->done && state_->invalid;
+    }
+
+    /** Returns `true` if `header` starts a psafe3 database of `size` bytes */
+    static bool IsValidHeader(const char *header, size_t len, uintmax_t size);
+
+private:
+    /** State shared with the worker thread, which can outlive the task */
+    struct State
+    {
+        std::atomic<bool> done{false};
+        std::atomic<bool> invalid{false};
+    };
+
+    std::string db_pathname_;
+    std::shared_ptr<State> state_;
+    std::thread thread_;
+};
+
+#endif
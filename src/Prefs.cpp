@@ -17,6 +17,11 @@ static std::map<std::string, std::string> DEFAULTS{
     {Prefs::DB_PATHNAME, "${HOME}/.pwsafe.dat"},
     {Prefs::BACKUP_BEFORE_SAVE, "true"},
     {Prefs::BACKUP_COUNT, "3"},
+    {Prefs::BACKUP_KEEP_HOURLY, "0"},
+    {Prefs::BACKUP_KEEP_DAILY, "7"},
+    {Prefs::BACKUP_KEEP_WEEKLY, "4"},
+    {Prefs::BACKUP_STRATEGY, "reflink"},
+    {Prefs::SAVE_DURABILITY, "file"},
 };
 
 Prefs Prefs::instance_;
@@ -23,11 +23,36 @@ public:
      */
     static constexpr const char *BACKUP_BEFORE_SAVE = "backup-before-save";
     /** 
-     * Count of backup database files to maintain, integer.
-     * Backup database files older than count will be removed 
-     * when a new backup is saved.
+     * Count of most recent backup database files to maintain, integer.
+     * Backup database files that are older and that are not kept 
+     * by `BACKUP_KEEP_HOURLY`, `BACKUP_KEEP_DAILY` or `BACKUP_KEEP_WEEKLY`
+     * will be removed when a new backup is saved.
      */
     static constexpr const char *BACKUP_COUNT = "backup-count";
+    /** Count of hours for which the most recent backup of the hour is kept, integer */
+    static constexpr const char *BACKUP_KEEP_HOURLY = "backup-keep-hourly";
+    /** Count of days for which the most recent backup of the day is kept, integer */
+    static constexpr const char *BACKUP_KEEP_DAILY = "backup-keep-daily";
+    /** Count of weeks for which the most recent backup of the week is kept, integer */
+    static constexpr const char *BACKUP_KEEP_WEEKLY = "backup-keep-weekly";
+    /**
+     * How backup database files are created, string.
+     * `copy` copies the file.
+     * `reflink` creates a copy that shares data blocks with the file
+     * if the file system supports it, otherwise copies the file.
+     * `link` creates a hard link to the file, which keeps the contents 
+     * of the file before saving because a save replaces the file.
+     * If a link cannot be created, the file is copied.
+     */
+    static constexpr const char *BACKUP_STRATEGY = "backup-strategy";
+    /**
+     * How the account database file is flushed to storage when saved, string.
+     * `none`, `file` to flush the file before it replaces the existing file,
+     * or `directory` to also flush the directory after the file is replaced.
+     * The existing file is always replaced atomically, so a backup is not
+     * required to protect against a partly written file.
+     */
+    static constexpr const char *SAVE_DURABILITY = "save-durability";
 
     /**
      * Initialize Prefs from defaults
@@ -0,0 +1,49 @@
+/* Copyright 2023 Ian Boisvert */
+#include "ReadDbTask.h"
+#include "AccountDb.h"
+
+ReadDbTask::ReadDbTask(const std::string &db_pathname, const std::string &password)
+{
+    thread_ = std::thread([this, db_pathname, password]() {
+        status_ = AccountDb::ReadPwsafeRecords(db_pathname, password, &records_, converted_, db_hash_, &rc_, 
+            [this](size_t count) {
+                record_count_ += count;
+                return !cancelled_;
+            });
+        // Derive the journal key now rather than when the first change is made
+        has_journal_secret_ = status_ && !cancelled_ && Journal::DeriveSecret(password, journal_secret_);
+        done_ = true;
+    });
+}
+
+ReadDbTask::~ReadDbTask()
+{
+    Cancel();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+    if (records_)
+    {
+        pws_free_db_records(records_);
+    }
+}
+
+bool ReadDbTask::Finish(AccountDb &db, int *rc)
+{
+    assert(thread_.joinable());
+    thread_.join();
+
+    PwsDbRecord *records = records_;
+    records_ = nullptr;
+    if (status_)
+    {
+        db.LoadRecords(records, std::move(converted_), db_hash_);
+        if (has_journal_secret_)
+        {
+            db.SetJournalSecret(journal_secret_);
+        }
+    }
+    SetResultCode(rc, rc_);
+    return status_;
+}
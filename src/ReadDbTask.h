@@ -0,0 +1,77 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_READDBTASK_H
+#define HAVE_READDBTASK_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libpwsafe.h"
+#include "AccountRecord.h"
+#include "Journal.h"
+
+struct AccountDb;
+
+/** 
+ * Reads and decrypts an account database on a worker thread,
+ * so the UI can respond to input while the key is derived.
+ */
+class ReadDbTask
+{
+public:
+    ReadDbTask(const std::string &db_pathname, const std::string &password);
+    ~ReadDbTask();
+
+    ReadDbTask(const ReadDbTask &) = delete;
+    ReadDbTask &operator=(const ReadDbTask &) = delete;
+
+    /** Returns `true` when the worker thread has finished reading the database */
+    bool IsDone() const
+    {
+        return done_;
+    }
+
+    /** 
+     * Number of records converted so far. Records are converted after 
+     * libpwsafe has decrypted and verified the whole file.
+     */
+    size_t RecordCount() const
+    {
+        return record_count_;
+    }
+
+    /** 
+     * Abandon reading the database. libpwsafe cannot be interrupted, the
+     * worker thread stops once the file is decrypted, before converting the
+     * records. The destructor waits for the worker thread.
+     */
+    void Cancel()
+    {
+        cancelled_ = true;
+    }
+
+    /** 
+     * Wait for the worker thread and add the records read to `db`.
+     * \returns The same result codes as `AccountDb::ReadDb()`
+     */
+    bool Finish(AccountDb &db, int *rc = nullptr);
+
+private:
+    std::atomic<bool> done_{false};
+    std::atomic<bool> cancelled_{false};
+    std::atomic<size_t> record_count_{0};
+    // Results of the worker thread, valid after it is joined
+    bool status_ = false;
+    int rc_ = 0;
+    PwsDbRecord *records_ = nullptr;
+    std::vector<AccountRecord> converted_;
+    uint64_t db_hash_ = 0;
+    Journal::Secret journal_secret_;
+    bool has_journal_secret_ = false;
+
+    std::thread thread_;
+};
+
+#endif
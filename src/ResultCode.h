@@ -14,7 +14,8 @@ enum ResultCode
     RC_ERR_FILE_DOESNT_EXIST,
     RC_ERR_CANT_OPEN_FILE,
     RC_ERR_READONLY,
-    RC_ERR_BACKUP
+    RC_ERR_BACKUP,
+    RC_ERR_CORRUPT_DB
 };
 
 inline void SetResultCode(int *prc, int rc)
@@ -1,4 +1,5 @@
 /* Copyright 2022 Ian Boisvert */
+#include <algorithm>
 #include <functional>
 
 #include "SafeCombinationPromptDlg.h"
@@ -6,6 +7,7 @@
 #include "MessageBox.h"
 #include "Filesystem.h"
 #include "PWSafeApp.h"
+#include "ReadDbTask.h"
 #include "Utils.h"
 
 SafeCombinationPromptDlg::SafeCombinationPromptDlg(PWSafeApp &app) : app_(app)
@@ -64,30 +66,100 @@ bool SafeCombinationPromptDlg::ValidateForm(const Dialog &dialog)
         } // !exists
     }
 
+    if (prefetch_ && prefetch_->DbPathname() == db_pathname && prefetch_->IsInvalid())
+    {
+        // No need to derive the key to find out the file is not valid
+        MessageBox(app_).Show(parent_win_, "Not a PasswordSafe database, or a corrupt database.");
+        redrawwin(dialog.GetWindow());
+        SetCommandBarWin();
+        return false;
+    }
+
     AccountDb &db = app_.GetDb();
     db.DbPathname() = db_pathname;
     db.Password() = password;
 
+    // Reading the database validates the password
     int rc;
-    if (!app_.GetDb().CheckPassword(&rc))
+    if (!ReadDb(dialog, rc))
     {
-        if (rc == RC_ERR_INCORRECT_PASSWORD)
+        if (rc == RC_USER_CANCEL)
+        {
+            // Continue editing
+        }
+        else if (rc == RC_ERR_INCORRECT_PASSWORD)
         {
             MessageBox(app_).Show(parent_win_, "Incorrect password");
-            redrawwin(dialog.GetWindow());
-            SetCommandBarWin();
+        }
+        else if (rc == RC_ERR_CORRUPT_DB)
+        {
+            MessageBox(app_).Show(parent_win_, "Not a PasswordSafe database, or a corrupt database.");
+        }
+        else if (rc == RC_ERR_CANT_OPEN_FILE)
+        {
+            std::string msg("Cannot read database file ");
+            msg.append(db_pathname);
+            MessageBox(app_).Show(parent_win_, msg.c_str());
         }
         else
         {
-            MessageBox(app_).Show(parent_win_, "Incorrect passkey, not a PasswordSafe database, or a corrupt database.");
-            redrawwin(dialog.GetWindow());
-            SetCommandBarWin();
+            std::string msg("An error occurred reading database file ");
+            msg.append(db_pathname);
+            MessageBox(app_).Show(parent_win_, msg.c_str());
         }
+        redrawwin(dialog.GetWindow());
+        SetCommandBarWin();
     }
 
     return rc == PRC_SUCCESS;
 }
 
+/** 
+ * Read the account database on a worker thread, 
+ * show progress and allow the user to cancel while the database is read.
+ */
+bool SafeCombinationPromptDlg::ReadDb(const Dialog &dialog, int &rc)
+{
+    static const int PROGRESS_DELAY_MS = 100;
+
+    cancelled_reads_.erase(std::remove_if(cancelled_reads_.begin(), cancelled_reads_.end(), 
+        [](const std::unique_ptr<ReadDbTask> &task) { return task->IsDone(); }), 
+        cancelled_reads_.end());
+
+    AccountDb &db = app_.GetDb();
+    auto task = std::make_unique<ReadDbTask>(db.DbPathname(), db.Password());
+
+    rc = RC_SUCCESS;
+    WINDOW *win = dialog.GetWindow();
+    wtimeout(win, PROGRESS_DELAY_MS);
+    while (!task->IsDone())
+    {
+        std::string status("Unlocking account database");
+        if (size_t count = task->RecordCount(); count > 0)
+        {
+            status.append(", ").append(std::to_string(count)).append(" accounts read");
+        }
+        app_.GetCommandBar().ShowProgress({{"^X", "Cancel"}}, status);
+
+        if (wgetch(win) == KEY_CTRL('X'))
+        {
+            // Don't wait for the worker thread to finish decrypting the database
+            task->Cancel();
+            cancelled_reads_.push_back(std::move(task));
+            rc = RC_USER_CANCEL;
+            break;
+        }
+    }
+    wtimeout(win, -1);
+    SetCommandBarWin();
+
+    if (rc == RC_USER_CANCEL)
+    {
+        return false;
+    }
+    return task->Finish(db, &rc);
+}
+
 void SafeCombinationPromptDlg::SetCommandBarWin()
 {
     app_.GetCommandBar().Show(this);
@@ -102,6 +174,11 @@ DialogResult SafeCombinationPromptDlg::Show(WINDOW *parent)
     SetCommandBarWin();
 
     const std::string &db_pathname = app_.GetDb().DbPathname();
+    if (!db_pathname.empty() && (!prefetch_ || prefetch_->DbPathname() != db_pathname))
+    {
+        prefetch_ = std::make_unique<PrefetchDbTask>(db_pathname);
+    }
+
     std::vector<DialogField> fields{
         {FT_FILEPATH, "Database:", db_pathname, /*m_width*/ 40, /*m_fieldOptsOn*/ 0, O_STATIC},
         {FT_PASSWORD, "Password:", "", /*m_width*/ 40, /*m_fieldOptsOn*/ 0, O_STATIC | O_PUBLIC}};
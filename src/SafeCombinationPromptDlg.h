@@ -2,6 +2,9 @@
 #pragma once
 
 #include "PWSafeApp.h"
+#include "PrefetchDbTask.h"
+#include "ReadDbTask.h"
+#include <memory>
 #include <vector>
 
 class Dialog;
@@ -32,7 +35,17 @@ private:
 
     WINDOW *parent_win_ = nullptr;
 
+    /** Reads the database file while the user enters the password */
+    std::unique_ptr<PrefetchDbTask> prefetch_;
+    /** 
+     * Reads cancelled by the user, whose worker threads are still decrypting
+     * the database. They are joined when they are done or the dialog is destroyed.
+     */
+    std::vector<std::unique_ptr<ReadDbTask>> cancelled_reads_;
+
     void SetCommandBarWin();
     bool InputHandler(Dialog &dialog, int &ch, DialogResult &result);
     bool ValidateForm(const Dialog &dialog);
+    /** Read the account database, `rc` is `RC_USER_CANCEL` if the user cancels */
+    bool ReadDb(const Dialog &dialog, int &rc);
 };
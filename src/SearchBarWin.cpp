@@ -3,7 +3,10 @@
 #include "CommandBarWin.h"
 #include "PWSafeApp.h"
 #include "Utils.h"
+#include "Collation.h"
+#include <algorithm>
 #include <utility>
+#include <vector>
 
 void SearchBarWin::InitTUI()
 {
@@ -11,12 +14,15 @@ void SearchBarWin::InitTUI()
 
     const std::vector<Action> actions{
         {"^L", "Next"},
+        {"^F", "Fuzzy"},
+        {"^T", "Filter"},
         {"Enter", "Exit"},
         {"Esc", "Cancel"},
     };
     CommandBarWin::ShowActions(app_, win_, actions);
 
-    waddstr(win_, "Search: ");
+    prompt_x_ = getcurx(win_);
+    ShowPrompt();
 
     int curx = getcurx(win_), cols = getmaxx(win_) - curx;
     fields_[0] = new_field(/*height*/ 1, cols, /*toprow*/ 0, /*leftcol*/ 0, /*offscreen*/ 0, /*nbuffers*/ 0);
@@ -35,6 +41,12 @@ void SearchBarWin::InitTUI()
     save_cursor_ = curs_set(1);
 }
 
+void SearchBarWin::ShowPrompt()
+{
+    // Prompts have the same width so the query field does not move
+    mvwaddstr(win_, /*y*/ 0, prompt_x_, fuzzy_ ? "Fuzzy:  " : "Search: ");
+}
+
 void SearchBarWin::EndTUI()
 {
     del_panel(panel_);
@@ -56,6 +68,11 @@ void SearchBarWin::EndTUI()
 void SearchBarWin::Show()
 {
     query_.clear();
+    folded_query_.clear();
+    search_.Clear();
+    fuzzy_search_.Clear();
+    fuzzy_rank_ = 0;
+    filter_ = accounts_win_.IsFiltered();
 
     const AccountRecord *psel = accounts_win_.GetSelection();
     auto &records = app_.GetDb().Records();
@@ -77,29 +94,6 @@ void SearchBarWin::Show()
     EndTUI();
 }
 
-/** Search title, name, user, notes fields for query */
-static bool Matches(const AccountRecord &account_rec, const std::string &query)
-{
-    // clang-format off
-    return 
-        account_rec.FieldContainsCaseInsensitive(FT_TITLE, query)
-        || account_rec.FieldContainsCaseInsensitive(FT_NAME, query)
-        || account_rec.FieldContainsCaseInsensitive(FT_USER, query)
-        || account_rec.FieldContainsCaseInsensitive(FT_NOTES, query);
-    // clang-format on
-}
-
-static AccountRecords::iterator FindNext(AccountRecords::iterator begin, AccountRecords::iterator end, const std::string &query)
-{
-    AccountRecords::iterator &it = begin;
-    for (; it != end; ++it)
-    {
-        if (Matches(*it, query))
-            break;
-    }
-    return it;
-}
-
 /**
  * Find the next match from the current match position.
  * Does not update the current match.
@@ -108,30 +102,43 @@ AccountRecords::iterator SearchBarWin::FindNextImpl(AccountRecords::iterator &st
 {
     auto &records = app_.GetDb().Records();
     AccountRecords::iterator begin = records.begin(), end = records.end();
-    if (begin == end)
+    const IncrementalSearch::Matches &matches = search_.Search(records, folded_query_);
+    if (matches.empty())
         return end;
 
-    AccountRecords::iterator it = start_iter;
-    if (it == end)
-    {
-        it = begin;
-    }
-    else
+    // First match after the start position, wrapping to the first match
+    auto it = matches.begin();
+    if (start_iter != end)
     {
-        ++it;
+        it = std::upper_bound(matches.begin(), matches.end(), static_cast<size_t>(start_iter - begin));
+        if (it == matches.end())
+        {
+            it = matches.begin();
+        }
     }
+    return begin + *it;
+}
 
-    it = ::FindNext(it, end, query_);
-    if (it == end && start_iter != begin)
-    {
-        // Wrap search
-        it = ::FindNext(begin, start_iter, query_);
-    }
-    return it;
+bool SearchBarWin::FindNextFuzzy()
+{
+    auto &records = app_.GetDb().Records();
+    const FuzzySearch::Matches &matches = fuzzy_search_.Search(records, folded_query_);
+    if (matches.empty())
+        return false;
+
+    fuzzy_rank_ %= matches.size();
+    transient_match_ = records.begin() + matches[fuzzy_rank_].pos;
+    accounts_win_.SetSelection(*transient_match_);
+    return true;
 }
 
 bool SearchBarWin::FindNext()
 {
+    if (fuzzy_)
+    {
+        return FindNextFuzzy();
+    }
+
     auto start_iter = last_match_;
     auto it = FindNextImpl(start_iter);
     auto end = app_.GetDb().Records().end();
@@ -170,6 +177,37 @@ void SearchBarWin::UpdateQueryString()
     FIELD *field = current_field(form_);
     char *cbuf = field_buffer(field, /*buffer*/ 0);
     query_ = rtrim(cbuf, cbuf + strlen(cbuf));
+    folded_query_.clear();
+    AppendFoldedText(query_.c_str(), folded_query_);
+    // A changed query selects the best fuzzy match
+    fuzzy_rank_ = 0;
+    UpdateFilter();
+}
+
+void SearchBarWin::UpdateFilter()
+{
+    if (!filter_ || query_.empty())
+    {
+        accounts_win_.ClearFilter();
+        return;
+    }
+
+    auto &records = app_.GetDb().Records();
+    if (fuzzy_)
+    {
+        // The account list is in sort order, not ranked
+        std::vector<size_t> positions;
+        for (const FuzzySearch::Match &match : fuzzy_search_.Search(records, folded_query_))
+        {
+            positions.push_back(match.pos);
+        }
+        std::sort(positions.begin(), positions.end());
+        accounts_win_.SetFilter(positions);
+    }
+    else
+    {
+        accounts_win_.SetFilter(search_.Search(records, folded_query_));
+    }
 }
 
 DialogResult SearchBarWin::ProcessInput()
@@ -183,11 +221,18 @@ DialogResult SearchBarWin::ProcessInput()
         switch (ch)
         {
         case '\n': {
+            // The account list keeps the filter, unless nothing matched
+            if (accounts_win_.IsFilterEmpty())
+            {
+                accounts_win_.ClearFilter();
+                ResetSavedMatch();
+            }
             rc = DialogResult::OK;
             goto done;
         }
         case KEY_CTRL('X'):
         case KEY_ESC: {
+            accounts_win_.ClearFilter();
             ResetSavedMatch();
             goto done;
         }
@@ -196,10 +241,37 @@ DialogResult SearchBarWin::ProcessInput()
             if (query_.size() > 0)
             {
                 last_match_ = transient_match_;
+                ++fuzzy_rank_;
                 update = FindNext();
             }
             break;
         }
+        case KEY_CTRL('F'): {
+            // Toggle fuzzy mode
+            fuzzy_ = !fuzzy_;
+            fuzzy_rank_ = 0;
+            ShowPrompt();
+            pos_form_cursor(form_);
+            UpdateFilter();
+            if (query_.size() > 0)
+            {
+                FindNext();
+            }
+            update = true;
+            break;
+        }
+        case KEY_CTRL('T'): {
+            // Toggle filter
+            filter_ = !filter_;
+            UpdateFilter();
+            if (query_.size() > 0)
+            {
+                FindNext();
+            }
+            pos_form_cursor(form_);
+            update = true;
+            break;
+        }
         case KEY_LEFT: {
             form_driver(form_, REQ_LEFT_CHAR);
             break;
@@ -6,6 +6,8 @@
 #include "libncurses.h"
 #include "PWSafeApp.h"
 #include "Dialog.h"
+#include "IncrementalSearch.h"
+#include "FuzzySearch.h"
 
 class AccountsWin;
 
@@ -27,6 +29,11 @@ private:
      */
     AccountRecords::iterator FindNextImpl(AccountRecords::iterator &start_iter);
     bool FindNext();
+    /** Select the match at `fuzzy_rank_` in the ranked fuzzy matches */
+    bool FindNextFuzzy();
+    void ShowPrompt();
+    /** Show only the matches of the query in the account list if `filter_` is set */
+    void UpdateFilter();
     void ResetSavedMatch();
     void ResetLastMatch();
     void SetSelection(AccountRecords::const_iterator it);
@@ -38,6 +45,12 @@ private:
     PWSafeApp &app_;
     AccountsWin &accounts_win_;
     std::string query_;
+    std::string folded_query_;                 ///< Query folded with `AppendFoldedText()`
+    IncrementalSearch search_;                 ///< Matches of the query and its prefixes
+    FuzzySearch fuzzy_search_;                 ///< Ranked matches of the query in fuzzy mode
+    bool fuzzy_ = false;                       ///< Fuzzy mode, toggled with ^F
+    size_t fuzzy_rank_ = 0;                    ///< Rank of the fuzzy match selected
+    bool filter_ = false;                      ///< Filter the account list, toggled with ^T
     AccountRecords::iterator save_match_;      ///< Item selected when search bar openend
     AccountRecords::iterator last_match_;      ///< Item selected after last "Find Next"
     AccountRecords::iterator transient_match_; ///< Item selected while typing query
@@ -48,4 +61,5 @@ private:
     WINDOW *form_win_ = nullptr;
     FIELD *fields_[2];
     int save_cursor_;
+    int prompt_x_ = 0;
 };
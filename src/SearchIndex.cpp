@@ -0,0 +1,208 @@
+/* Copyright 2023 Ian Boisvert */
+#include <algorithm>
+#include <iterator>
+#include "SearchIndex.h"
+
+// Pending additions and removals merged into the encoded postings when exceeded
+static constexpr size_t MAX_PENDING = 256;
+// Postings longer than this multiple of the candidate count are not intersected,
+// verifying the candidates is faster than decoding the postings
+static constexpr size_t MAX_INTERSECT_RATIO = 16;
+
+void SearchIndex::Postings::Append(RecordId id)
+{
+    uint32_t delta = packed_count_ == 0 ? id : id - packed_last_;
+    while (delta >= 0x80)
+    {
+        data_.push_back(static_cast<uint8_t>(delta | 0x80));
+        delta >>= 7;
+    }
+    data_.push_back(static_cast<uint8_t>(delta));
+    packed_last_ = id;
+    ++packed_count_;
+}
+
+void SearchIndex::Postings::Compact()
+{
+    std::vector<RecordId> ids;
+    Decode(ids);
+    data_.clear();
+    packed_count_ = 0;
+    added_.clear();
+    removed_.clear();
+    for (RecordId id : ids)
+    {
+        Append(id);
+    }
+    data_.shrink_to_fit();
+}
+
+void SearchIndex::Postings::Add(RecordId id)
+{
+    // An ID removed and added again is still in the encoded postings
+    if (auto it = std::lower_bound(removed_.begin(), removed_.end(), id); it != removed_.end() && *it == id)
+    {
+        removed_.erase(it);
+        return;
+    }
+    if (added_.empty() && (packed_count_ == 0 || id > packed_last_))
+    {
+        Append(id);
+        return;
+    }
+    auto it = std::lower_bound(added_.begin(), added_.end(), id);
+    if (it != added_.end() && *it == id) return;
+    added_.insert(it, id);
+    if (added_.size() + removed_.size() > MAX_PENDING)
+    {
+        Compact();
+    }
+}
+
+void SearchIndex::Postings::Remove(RecordId id)
+{
+    if (auto it = std::lower_bound(added_.begin(), added_.end(), id); it != added_.end() && *it == id)
+    {
+        added_.erase(it);
+        return;
+    }
+    auto it = std::lower_bound(removed_.begin(), removed_.end(), id);
+    if (it != removed_.end() && *it == id) return;
+    removed_.insert(it, id);
+    if (added_.size() + removed_.size() > MAX_PENDING)
+    {
+        Compact();
+    }
+}
+
+void SearchIndex::Postings::Decode(std::vector<RecordId> &ids) const
+{
+    ids.clear();
+    ids.reserve(packed_count_ + added_.size());
+    RecordId id = 0;
+    for (size_t pos = 0, len = data_.size(); pos < len;)
+    {
+        uint32_t delta = 0;
+        for (int shift = 0; ; shift += 7)
+        {
+            uint8_t byte = data_[pos++];
+            delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        id = ids.empty() ? delta : id + delta;
+        ids.push_back(id);
+    }
+
+    if (!removed_.empty())
+    {
+        auto end = std::remove_if(ids.begin(), ids.end(), [this](RecordId value) {
+            return std::binary_search(removed_.begin(), removed_.end(), value);
+        });
+        ids.erase(end, ids.end());
+    }
+    if (!added_.empty())
+    {
+        size_t mid = ids.size();
+        ids.insert(ids.end(), added_.begin(), added_.end());
+        std::inplace_merge(ids.begin(), ids.begin() + mid, ids.end());
+    }
+}
+
+std::vector<SearchIndex::Trigram> SearchIndex::Trigrams(const std::string &text)
+{
+    std::vector<Trigram> trigrams;
+    const auto *bytes = reinterpret_cast<const uint8_t *>(text.data());
+    for (size_t i = 0, len = text.size(); i + 3 <= len; ++i)
+    {
+        if (!bytes[i] || !bytes[i+1] || !bytes[i+2]) continue;
+        trigrams.push_back(static_cast<Trigram>(bytes[i]) << 16 | bytes[i+1] << 8 | bytes[i+2]);
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+void SearchIndex::RemovePosting(Trigram trigram, RecordId id)
+{
+    auto it = postings_.find(trigram);
+    if (it == postings_.end()) return;
+    it->second.Remove(id);
+    if (it->second.size() == 0)
+    {
+        postings_.erase(it);
+    }
+}
+
+void SearchIndex::Add(RecordId id, const std::string &text)
+{
+    for (Trigram trigram : Trigrams(text))
+    {
+        postings_[trigram].Add(id);
+    }
+}
+
+void SearchIndex::Remove(RecordId id, const std::string &text)
+{
+    for (Trigram trigram : Trigrams(text))
+    {
+        RemovePosting(trigram, id);
+    }
+}
+
+void SearchIndex::Update(RecordId id, const std::string &old_text, const std::string &new_text)
+{
+    // Only the postings of trigrams that were added or removed are changed
+    std::vector<Trigram> old_trigrams = Trigrams(old_text), new_trigrams = Trigrams(new_text);
+    std::vector<Trigram> changed;
+    std::set_difference(old_trigrams.begin(), old_trigrams.end(), new_trigrams.begin(), new_trigrams.end(),
+        std::back_inserter(changed));
+    for (Trigram trigram : changed)
+    {
+        RemovePosting(trigram, id);
+    }
+    changed.clear();
+    std::set_difference(new_trigrams.begin(), new_trigrams.end(), old_trigrams.begin(), old_trigrams.end(),
+        std::back_inserter(changed));
+    for (Trigram trigram : changed)
+    {
+        postings_[trigram].Add(id);
+    }
+}
+
+bool SearchIndex::FindCandidates(const std::string &folded_query, std::vector<RecordId> &ids) const
+{
+    std::vector<Trigram> trigrams = Trigrams(folded_query);
+    if (trigrams.empty())
+    {
+        return false;
+    }
+
+    ids.clear();
+    std::vector<const Postings *> lists;
+    for (Trigram trigram : trigrams)
+    {
+        auto it = postings_.find(trigram);
+        if (it == postings_.end())
+        {
+            // No record contains this trigram
+            return true;
+        }
+        lists.push_back(&it->second);
+    }
+
+    // Intersect the shortest postings first
+    std::sort(lists.begin(), lists.end(), [](const Postings *a, const Postings *b) {
+        return a->size() < b->size();
+    });
+    lists.front()->Decode(ids);
+    std::vector<RecordId> other;
+    for (auto it = lists.begin() + 1; it != lists.end() && !ids.empty(); ++it)
+    {
+        if ((*it)->size() > ids.size() * MAX_INTERSECT_RATIO) break;
+        (*it)->Decode(other);
+        std::vector<RecordId> intersection;
+        std::set_intersection(ids.begin(), ids.end(), other.begin(), other.end(), std::back_inserter(intersection));
+        ids.swap(intersection);
+    }
+    return true;
+}
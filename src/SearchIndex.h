@@ -0,0 +1,88 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_SEARCHINDEX_H
+#define HAVE_SEARCHINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * Trigram index of the folded search text of records, see `AccountRecord::SearchText()`.
+ *
+ * Each trigram (3 consecutive bytes of the text, not including the 0 byte
+ * that ends a field) maps to the sorted IDs of the records whose text contains it.
+ * A query of at least 3 bytes can only be contained in records that are
+ * in the postings of all of its trigrams, so these records are the candidates
+ * that must be verified with `AccountRecord::SearchTextContains()`.
+ */
+class SearchIndex
+{
+public:
+    typedef uint32_t RecordId;
+
+private:
+    typedef uint32_t Trigram;
+
+    /**
+     * Sorted record IDs containing a trigram.
+     *
+     * IDs are stored as varint-encoded deltas. IDs added out of order
+     * and removed IDs are kept in small sorted lists that are merged into the
+     * encoded IDs when they grow too large, so that updates do not re-encode
+     * the postings of common trigrams.
+     */
+    class Postings
+    {
+        std::vector<uint8_t> data_;
+        size_t packed_count_ = 0;
+        RecordId packed_last_ = 0;
+        std::vector<RecordId> added_;
+        std::vector<RecordId> removed_;
+
+        void Append(RecordId id);
+        void Compact();
+
+    public:
+        size_t size() const
+        {
+            return packed_count_ + added_.size() - removed_.size();
+        }
+
+        void Add(RecordId id);
+        void Remove(RecordId id);
+        /** Replace `ids` with the IDs in the postings, in ascending order */
+        void Decode(std::vector<RecordId> &ids) const;
+    };
+
+    std::unordered_map<Trigram, Postings> postings_;
+
+    /** Sorted distinct trigrams of `text` */
+    static std::vector<Trigram> Trigrams(const std::string &text);
+    /** Remove `id` from the postings of `trigram`, erasing empty postings */
+    void RemovePosting(Trigram trigram, RecordId id);
+
+public:
+    /** Add record `id` having folded search text `text` */
+    void Add(RecordId id, const std::string &text);
+    /** Remove record `id`, `text` must be the text it was added with */
+    void Remove(RecordId id, const std::string &text);
+    /** Update the postings of record `id` for changed search text */
+    void Update(RecordId id, const std::string &old_text, const std::string &new_text);
+    void Clear()
+    {
+        postings_.clear();
+    }
+
+    /**
+     * Find the records that may contain `folded_query`.
+     *
+     * \param[out] ids Candidate record IDs in ascending order, a superset of the
+     *   records containing the query
+     * \returns `false` if the query is too short to use the index, in which case
+     *   every record is a candidate and `ids` is not set
+     */
+    bool FindCandidates(const std::string &folded_query, std::vector<RecordId> &ids) const;
+};
+
+#endif  //#ifndef HAVE_SEARCHINDEX_H
@@ -0,0 +1,98 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_UUID_H
+#define HAVE_UUID_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+/**
+ * A 128-bit account record UUID, stored as binary.
+ *
+ * Account databases store the UUID as a string of 32 hex digits.
+ * Parsing it to 16 bytes allows UUIDs to be compared and hashed
+ * without any string handling.
+ */
+struct Uuid
+{
+    std::array<uint8_t, 16> bytes{};
+
+    /**
+     * Convert the string value of a `FT_UUID` field to binary.
+     *
+     * Hex digits are not case sensitive. If `str` is not 32 hex digits
+     * (i.e. it was not generated by `pws_generate_uuid()`),
+     * the UUID is derived from a hash of the string so that
+     * equal strings always have equal UUIDs.
+     */
+    static Uuid FromString(const char *str)
+    {
+        Uuid uuid;
+        if (!str) str = "";
+        if (!uuid.ParseHex(str))
+        {
+            uuid.HashString(str);
+        }
+        return uuid;
+    }
+
+    bool operator==(const Uuid &other) const
+    {
+        return bytes == other.bytes;
+    }
+    bool operator!=(const Uuid &other) const
+    {
+        return bytes != other.bytes;
+    }
+
+    /** UUIDs are random, the first 8 bytes are a good enough hash */
+    struct Hash
+    {
+        size_t operator()(const Uuid &uuid) const
+        {
+            uint64_t h;
+            memcpy(&h, uuid.bytes.data(), sizeof(h));
+            return static_cast<size_t>(h);
+        }
+    };
+
+private:
+    static int HexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    bool ParseHex(const char *str)
+    {
+        for (size_t i = 0; i < bytes.size(); ++i)
+        {
+            int hi = HexValue(str[2*i]);
+            if (hi < 0) return false;
+            int lo = HexValue(str[2*i+1]);
+            if (lo < 0) return false;
+            bytes[i] = static_cast<uint8_t>((hi << 4) | lo);
+        }
+        return str[2*bytes.size()] == '\0';
+    }
+
+    /** FNV-1a, once for each half of the UUID with a different offset basis */
+    void HashString(const char *str)
+    {
+        uint64_t h[2] = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL};
+        for (uint64_t &hash : h)
+        {
+            for (const char *p = str; *p; ++p)
+            {
+                hash ^= static_cast<uint8_t>(*p);
+                hash *= 0x100000001b3ULL;
+            }
+        }
+        memcpy(bytes.data(), h, bytes.size());
+    }
+};
+
+#endif  //#ifndef HAVE_UUID_H
@@ -3,5 +3,8 @@
 #define HAVE_LIBICU_H
 
 #include <unicode/unistr.h>
+#include <unicode/coll.h>
+#include <unicode/normalizer2.h>
+#include <unicode/utf8.h>
 
 #endif  //#ifndef HAVE_LIBICU_H
\ No newline at end of file
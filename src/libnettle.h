@@ -0,0 +1,9 @@
+/* Copyright 2023 Ian Boisvert */
+#ifndef HAVE_LIBNETTLE_H
+#define HAVE_LIBNETTLE_H
+
+#include <nettle/gcm.h>
+#include <nettle/memops.h>
+#include <nettle/pbkdf2.h>
+
+#endif  //#ifndef HAVE_LIBNETTLE_H
@@ -506,6 +506,14 @@ int main(int argc, char *argv[])
         {
             fprintf(stdout, "Incorrect account database password\n");
         }
+        else if (rc == RC_ERR_CORRUPT_DB)
+        {
+            fprintf(stdout, "Not a PasswordSafe database, or a corrupt database\n");
+        }
+        else if (rc == RC_ERR_CANT_OPEN_FILE)
+        {
+            fprintf(stdout, "Cannot read account database file: %s\n", strerror(errno));
+        }
         else
         {
             fprintf(stdout, "Changing account database password failed\n");
@@ -550,9 +558,10 @@ int main(int argc, char *argv[])
             result = static_cast<int>(RC_FAILURE);
             if (rc == RC_ERR_CANT_OPEN_FILE)
             {
-                fprintf(stderr, "Error %d creating export file: %s\n", errno, strerror(errno));
+                // The database file cannot be read or the export file cannot be created
+                fprintf(stderr, "Error %d opening file: %s\n", errno, strerror(errno));
             }
-            else if (rc == RC_ERR_INCORRECT_PASSWORD)
+            else if (rc == RC_ERR_INCORRECT_PASSWORD || rc == RC_ERR_CORRUPT_DB)
             {
                 fprintf(stderr, "An error occurred reading database file %s\n", args.database_.c_str());
             }
@@ -1,9 +1,17 @@
 /* Copyright 2023 Ian Boisvert */
+#include <filesystem>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <fstream>
 #include <string>
+#include <map>
 #include <memory>
 #include <gtest/gtest.h>
 #include "libpwsafe.h"
 #include "AccountDb.h"
+#include "ReadDbTask.h"
+#include "PrefetchDbTask.h"
 
 TEST(AccountDbTest, TestConvertToPwsafeSucceeds)
 {
@@ -17,10 +25,11 @@ TEST(AccountDbTest, TestConvertToPwsafeSucceeds)
     AccountDb db;
     db.records_ = records;
 
-    std::unique_ptr<PwsDbRecord, decltype(&pws_free_db_records)> precords_pwsafe(db.ConvertToPwsafeRecords(), &pws_free_db_records);
+    // Converted records are owned by db
+    PwsDbRecord *precords_pwsafe = db.ConvertToPwsafeRecords();
     // Count records and fields
     size_t nrec = 0, nfields = 0;
-    PwsDbRecord *prec = precords_pwsafe.get();
+    PwsDbRecord *prec = precords_pwsafe;
     while (prec)
     {
         ++nrec;
@@ -36,3 +45,287 @@ TEST(AccountDbTest, TestConvertToPwsafeSucceeds)
     ASSERT_EQ(3, nrec);
     ASSERT_EQ(9, nfields);
 }
+
+TEST(AccountDbTest, TestConvertToPwsafeReusesUnchangedRecords)
+{
+    AccountDb db;
+    db.Records() = AccountRecords{
+        {{FT_TITLE, "acct1"}, {FT_UUID, "uuid1"}},
+        {{FT_TITLE, "acct2"}, {FT_UUID, "uuid2"}},
+        {{FT_TITLE, "acct3"}, {FT_UUID, "uuid3"}},
+    };
+
+    auto convert = [&db]() {
+        std::map<std::string, const PwsDbRecord *> converted;
+        for (const PwsDbRecord *prec = db.ConvertToPwsafeRecords(); prec; prec = prec->next)
+        {
+            converted[pws_rec_get_field(prec, FT_TITLE)] = prec;
+        }
+        return converted;
+    };
+    auto before = convert();
+    ASSERT_EQ(3, before.size());
+
+    db.Records().Save({{FT_TITLE, "acct2"}, {FT_USER, "user"}, {FT_UUID, "uuid2"}});
+    ASSERT_TRUE(db.Records().Delete(*db.Records().Find(FT_UUID, "uuid3")));
+    db.Records().Save({{FT_TITLE, "acct4"}, {FT_UUID, "uuid4"}});
+    auto after = convert();
+    ASSERT_EQ(3, after.size());
+    ASSERT_EQ(before["acct1"], after["acct1"]);
+    ASSERT_STREQ("user", pws_rec_get_field(after["acct2"], FT_USER));
+    ASSERT_STREQ("uuid4", pws_rec_get_field(after["acct4"], FT_UUID));
+
+    // Changes are not lost if the dirty state is cleared between conversions
+    db.Records().Save({{FT_TITLE, "acct1"}, {FT_USER, "user1"}, {FT_UUID, "uuid1"}});
+    db.ClearDirty();
+    after = convert();
+    ASSERT_STREQ("user1", pws_rec_get_field(after["acct1"], FT_USER));
+}
+
+TEST(AccountDbTest, TestReadDbMissingFileFails)
+{
+    AccountDb db;
+    db.DbPathname() = "/nonexistent/ncpwsafe-test.psafe3";
+    db.Password() = "password";
+
+    int rc = RC_SUCCESS;
+    ASSERT_FALSE(db.ReadDb(&rc));
+    ASSERT_EQ(RC_ERR_FILE_DOESNT_EXIST, rc);
+    ASSERT_EQ(0, db.Records().size());
+}
+
+TEST(AccountDbTest, TestReadDbTaskMissingFileFails)
+{
+    AccountDb db;
+    ReadDbTask task("/nonexistent/ncpwsafe-test.psafe3", "password");
+
+    int rc = RC_SUCCESS;
+    ASSERT_FALSE(task.Finish(db, &rc));
+    ASSERT_TRUE(task.IsDone());
+    ASSERT_EQ(RC_ERR_FILE_DOESNT_EXIST, rc);
+    ASSERT_EQ(0, db.Records().size());
+}
+
+TEST(AccountDbTest, TestPrefetchDbTaskValidatesHeader)
+{
+    const size_t min_size = PrefetchDbTask::HEADER_SIZE + PrefetchDbTask::TRAILER_SIZE;
+    ASSERT_TRUE(PrefetchDbTask::IsValidHeader("PWS3", 4, min_size));
+    ASSERT_FALSE(PrefetchDbTask::IsValidHeader("PWS3", 4, min_size - 1));
+    ASSERT_FALSE(PrefetchDbTask::IsValidHeader("PWS2", 4, min_size));
+    ASSERT_FALSE(PrefetchDbTask::IsValidHeader("PWS", 3, min_size));
+}
+
+TEST(AccountDbTest, TestConvertRecordsParallelMatchesSerial)
+{
+    PwsDbRecord *phead = nullptr;
+    for (int i = 0; i < 10000; ++i)
+    {
+        std::string n = std::to_string(i);
+        AccountRecord rec{{FT_GROUP, "grp" + std::to_string(i % 10)}, {FT_TITLE, "acct" + n}, {FT_UUID, "uuid" + n}};
+        PwsDbRecord *prec = rec.ToPwsDbRecord(nullptr);
+        prec->next = phead;
+        phead = prec;
+    }
+    std::unique_ptr<PwsDbRecord, decltype(&pws_free_db_records)> precords{phead, pws_free_db_records};
+
+    std::vector<AccountRecord> serial, parallel;
+    ASSERT_TRUE(AccountDb::ConvertRecords(phead, 1, serial));
+    std::atomic<size_t> progress_count{0}, progress_calls{0};
+    ASSERT_TRUE(AccountDb::ConvertRecords(phead, 4, parallel, [&](size_t count) {
+        progress_count += count;
+        ++progress_calls;
+        return true;
+    }));
+
+    ASSERT_EQ(10000, serial.size());
+    // Progress is reported as records are converted, not once at the end
+    ASSERT_EQ(10000, progress_count);
+    ASSERT_LT(4, progress_calls);
+    ASSERT_EQ(serial.size(), parallel.size());
+    for (size_t i = 0; i < serial.size(); ++i)
+    {
+        for (uint8_t field_type : AccountRecord::FIELD_TYPES)
+        {
+            ASSERT_STREQ(serial[i].GetField(field_type, ""), parallel[i].GetField(field_type, ""));
+        }
+    }
+
+    // Conversion stops before the next batch when the progress callback returns false
+    progress_count = 0;
+    ASSERT_FALSE(AccountDb::ConvertRecords(phead, 4, parallel, [&](size_t count) {
+        progress_count += count;
+        return false;
+    }));
+    ASSERT_TRUE(parallel.empty());
+    ASSERT_GE(4 * 256, progress_count);
+}
+
+TEST(AccountDbTest, TestConvertToPwsafeParallelMatchesSerial)
+{
+    AccountDb serial_db, parallel_db;
+    for (int i = 0; i < 10000; ++i)
+    {
+        std::string n = std::to_string(i);
+        AccountRecord rec{{FT_GROUP, "grp" + std::to_string(i % 10)}, {FT_TITLE, "acct" + n}, {FT_UUID, "uuid" + n}};
+        serial_db.Records().Append(AccountRecord(rec));
+        parallel_db.Records().Append(std::move(rec));
+    }
+    serial_db.Records().SortRecords();
+    parallel_db.Records().SortRecords();
+
+    const PwsDbRecord *serial = serial_db.ConvertToPwsafeRecords(1);
+    const PwsDbRecord *parallel = parallel_db.ConvertToPwsafeRecords(4);
+    size_t nrec = 0;
+    for (; serial && parallel; serial = serial->next, parallel = parallel->next, ++nrec)
+    {
+        for (uint8_t field_type : AccountRecord::FIELD_TYPES)
+        {
+            const char *expected = pws_rec_get_field(serial, (PwsFieldType)field_type);
+            const char *actual = pws_rec_get_field(parallel, (PwsFieldType)field_type);
+            ASSERT_STREQ(expected ? expected : "", actual ? actual : "");
+        }
+    }
+    ASSERT_EQ(nullptr, serial);
+    ASSERT_EQ(nullptr, parallel);
+    ASSERT_EQ(10000, nrec);
+}
+
+TEST(AccountDbTest, TestWriteDbReplacesFile)
+{
+    namespace sfs = std::filesystem;
+    sfs::path dir = sfs::temp_directory_path() / "ncpwsafe-writedb-test";
+    sfs::remove_all(dir);
+    sfs::create_directories(dir);
+
+    AccountDb db;
+    db.DbPathname() = (dir / "test.psafe3").string();
+    db.Password() = "password";
+    db.SaveDurability() = AccountDb::Durability::DIRECTORY;
+    db.Records() = AccountRecords{
+        {{FT_TITLE, "acct1"}, {FT_UUID, "uuid1"}},
+        {{FT_TITLE, "acct2"}, {FT_UUID, "uuid2"}},
+    };
+    int rc = RC_FAILURE;
+    ASSERT_TRUE(db.WriteDb(&rc));
+    ASSERT_EQ(RC_SUCCESS, rc);
+    ASSERT_TRUE(db.WriteDb(&rc));
+
+    // The temporary file was renamed over the database file
+    ASSERT_EQ(1, std::distance(sfs::directory_iterator(dir), sfs::directory_iterator()));
+
+    AccountDb read_db;
+    read_db.DbPathname() = db.DbPathname();
+    read_db.Password() = db.Password();
+    ASSERT_TRUE(read_db.ReadDb(&rc));
+    ASSERT_EQ(2, read_db.Records().size());
+
+    sfs::remove_all(dir);
+}
+
+TEST(AccountDbTest, TestJournalReplay)
+{
+    namespace sfs = std::filesystem;
+    sfs::path dir = sfs::temp_directory_path() / "ncpwsafe-journal-test";
+    sfs::remove_all(dir);
+    sfs::create_directories(dir);
+
+    AccountDb db;
+    db.DbPathname() = (dir / "test.psafe3").string();
+    db.Password() = "password";
+    db.Records() = AccountRecords{
+        {{FT_TITLE, "acct1"}, {FT_UUID, "uuid1"}},
+        {{FT_TITLE, "acct2"}, {FT_UUID, "uuid2"}},
+    };
+    ASSERT_TRUE(db.WriteDb());
+    db.ClearDirty();
+    ASSERT_FALSE(db.HasJournal());
+
+    // The key derived when the database was unlocked is used for the journal
+    Journal::Secret secret;
+    ASSERT_TRUE(Journal::DeriveSecret(db.Password(), secret));
+    db.SetJournalSecret(secret);
+
+    AccountRecords &records = db.Records();
+    records.Save({{FT_TITLE, "acct1 changed"}, {FT_UUID, "uuid1"}});
+    ASSERT_TRUE(db.WriteJournal());
+    {
+        // The salt follows the magic
+        std::ifstream fs(db.JournalPathname(), std::ios::binary);
+        std::array<char, Journal::SALT_LEN> salt;
+        fs.seekg(8);
+        fs.read(salt.data(), salt.size());
+        ASSERT_EQ(0, memcmp(secret.salt.data(), salt.data(), salt.size()));
+    }
+    records.Delete(*records.Find(FT_UUID, "uuid2"));
+    records.Save({{FT_GROUP, "grp"}, {FT_TITLE, "acct3"}, {FT_UUID, "uuid3"}});
+    ASSERT_TRUE(db.WriteJournal());
+    ASSERT_TRUE(db.HasJournal());
+
+    AccountDb recovered;
+    recovered.DbPathname() = db.DbPathname();
+    recovered.Password() = db.Password();
+    ASSERT_TRUE(recovered.ReadDb());
+    recovered.ClearDirty();
+    int rc = RC_FAILURE;
+    ASSERT_TRUE(recovered.ReplayJournal(&rc));
+    ASSERT_EQ(RC_SUCCESS, rc);
+    ASSERT_TRUE(recovered.IsDirty());
+
+    AccountRecords &rrecords = recovered.Records();
+    ASSERT_EQ(2, rrecords.size());
+    ASSERT_STREQ("acct1 changed", rrecords.Find(FT_UUID, "uuid1")->GetField(FT_TITLE));
+    ASSERT_EQ(rrecords.end(), rrecords.Find(FT_UUID, "uuid2"));
+    ASSERT_STREQ("grp", rrecords.Find(FT_UUID, "uuid3")->GetField(FT_GROUP));
+
+    // Saving removes the journal
+    ASSERT_TRUE(recovered.WriteDb());
+    ASSERT_FALSE(recovered.HasJournal());
+
+    // A journal written with another password is not valid
+    recovered.ClearDirty();
+    rrecords.Save({{FT_TITLE, "acct4"}, {FT_UUID, "uuid4"}});
+    ASSERT_TRUE(recovered.WriteJournal());
+    AccountDb other;
+    other.DbPathname() = db.DbPathname();
+    other.Password() = "wrong";
+    ASSERT_FALSE(other.ReplayJournal(&rc));
+    ASSERT_EQ(RC_ERR_CORRUPT_DB, rc);
+
+    sfs::remove_all(dir);
+}
+
+TEST(AccountDbTest, TestJournalCorruptHeader)
+{
+    namespace sfs = std::filesystem;
+    sfs::path dir = sfs::temp_directory_path() / "ncpwsafe-journal-header-test";
+    sfs::remove_all(dir);
+    sfs::create_directories(dir);
+
+    AccountDb db;
+    db.DbPathname() = (dir / "test.psafe3").string();
+    db.Password() = "password";
+    db.Records() = AccountRecords{{{FT_TITLE, "acct1"}, {FT_UUID, "uuid1"}}};
+    ASSERT_TRUE(db.WriteDb());
+    db.ClearDirty();
+    db.Records().Save({{FT_TITLE, "acct2"}, {FT_UUID, "uuid2"}});
+    ASSERT_TRUE(db.WriteJournal());
+
+    // The KDF iteration count follows the magic and the salt
+    auto write_iterations = [&db](uint32_t iterations) {
+        std::fstream fs(db.JournalPathname(), std::ios::binary | std::ios::in | std::ios::out);
+        fs.seekp(8 + 16);
+        for (int i = 0; i < 4; ++i) fs.put(static_cast<char>(iterations >> (8 * i)));
+    };
+    for (uint32_t iterations : {0u, 0xffffffffu})
+    {
+        write_iterations(iterations);
+        AccountDb recovered;
+        recovered.DbPathname() = db.DbPathname();
+        recovered.Password() = db.Password();
+        int rc = RC_FAILURE;
+        ASSERT_FALSE(recovered.ReplayJournal(&rc));
+        ASSERT_EQ(RC_ERR_CORRUPT_DB, rc);
+    }
+
+    sfs::remove_all(dir);
+}
@@ -0,0 +1,432 @@
+/* Copyright 2023 Ian Boisvert */
+#include <string>
+#include <gtest/gtest.h>
+#include "AccountRecords.h"
+#include "Collation.h"
+#include "IncrementalSearch.h"
+#include "FuzzySearch.h"
+
+TEST(AccountRecordsTest, TestFindByUuid)
+{
+    AccountRecords records{
+        {{FT_GROUP, "grp2"}, {FT_TITLE, "acct3"}, {FT_UUID, "uuid3"}},
+        {{FT_GROUP, "grp1"}, {FT_TITLE, "acct1"}, {FT_UUID, "0123456789abcdef0123456789ABCDEF"}},
+    };
+
+    auto it = records.Find(FT_UUID, "uuid3");
+    ASSERT_NE(records.end(), it);
+    ASSERT_STREQ("acct3", it->GetField(FT_TITLE));
+
+    // Hex UUIDs are not case sensitive
+    it = records.Find(FT_UUID, "0123456789ABCDEF0123456789abcdef");
+    ASSERT_NE(records.end(), it);
+    ASSERT_STREQ("acct1", it->GetField(FT_TITLE));
+
+    ASSERT_EQ(records.end(), records.Find(FT_UUID, "uuid1"));
+    ASSERT_EQ(records.end(), records.Find(FT_UUID, ""));
+}
+
+TEST(AccountRecordsTest, TestUuidIndexAfterSaveAndDelete)
+{
+    AccountRecords records;
+    records.Save({{FT_GROUP, "grp2"}, {FT_TITLE, "acct3"}, {FT_UUID, "uuid3"}});
+    records.Save({{FT_GROUP, "grp1"}, {FT_TITLE, "acct1"}, {FT_UUID, "uuid1"}});
+    records.Save({{FT_GROUP, "grp1"}, {FT_TITLE, "acct2"}, {FT_UUID, "uuid2"}});
+
+    // Records are sorted, index must follow
+    ASSERT_STREQ("uuid1", records.begin()->GetField(FT_UUID));
+    ASSERT_STREQ("acct3", records.Find(FT_UUID, "uuid3")->GetField(FT_TITLE));
+
+    ASSERT_TRUE(records.Delete({{FT_UUID, "uuid1"}}));
+    ASSERT_FALSE(records.Delete({{FT_UUID, "uuid1"}}));
+    ASSERT_EQ(records.end(), records.Find(FT_UUID, "uuid1"));
+    ASSERT_STREQ("acct2", records.Find(FT_UUID, "uuid2")->GetField(FT_TITLE));
+    ASSERT_STREQ("acct3", records.Find(FT_UUID, "uuid3")->GetField(FT_TITLE));
+
+    // Update existing record
+    auto id = records.Save({{FT_GROUP, "grp0"}, {FT_TITLE, "acct3a"}, {FT_UUID, "uuid3"}});
+    ASSERT_EQ(id, records.begin().Id());
+    ASSERT_STREQ("acct3a", records.Find(FT_UUID, "uuid3")->GetField(FT_TITLE));
+    ASSERT_EQ(2, std::distance(records.begin(), records.end()));
+}
+
+TEST(AccountRecordsTest, TestBulkLoad)
+{
+    // Large enough to use the parallel sort
+    constexpr int count = 20000;
+    char buf[32];
+
+    AccountRecords records;
+    records.Reserve(count);
+    for (int i = count-1; i >= 0; --i)
+    {
+        snprintf(buf, sizeof(buf), "%08d", i);
+        records.Append({{FT_GROUP, i % 2 ? "odd" : "even"}, {FT_TITLE, buf}, {FT_UUID, buf}});
+    }
+    // Duplicate UUID replaces existing record
+    records.Append({{FT_GROUP, "even"}, {FT_TITLE, "dup"}, {FT_UUID, "00000000"}});
+    records.SortRecords(/*nthreads*/ 3);
+
+    ASSERT_EQ(count, std::distance(records.begin(), records.end()));
+    ASSERT_TRUE(std::is_sorted(records.begin(), records.end(), [](const AccountRecord &a, const AccountRecord &b) {
+        int cmp = strcmp(a.GetField(FT_GROUP), b.GetField(FT_GROUP));
+        return cmp < 0 || (cmp == 0 && strcmp(a.GetField(FT_TITLE), b.GetField(FT_TITLE)) < 0);
+    }));
+    ASSERT_STREQ("dup", records.Find(FT_UUID, "00000000")->GetField(FT_TITLE));
+    ASSERT_STREQ("00000001", records.Find(FT_UUID, "00000001")->GetField(FT_TITLE));
+}
+
+TEST(AccountRecordsTest, TestSaveKeepsSortOrder)
+{
+    AccountRecords records;
+    auto id_b = records.Save({{FT_GROUP, "grp"}, {FT_TITLE, "b"}, {FT_UUID, "uuid_b"}});
+    auto id_d = records.Save({{FT_GROUP, "grp"}, {FT_TITLE, "d"}, {FT_UUID, "uuid_d"}});
+    auto id_a = records.Save({{FT_GROUP, "grp"}, {FT_TITLE, "a"}, {FT_UUID, "uuid_a"}});
+    auto id_c = records.Save({{FT_GROUP, "grp"}, {FT_TITLE, "c"}, {FT_UUID, "uuid_c"}});
+    const AccountRecord *prec_c = &records[id_c];
+
+    auto titles = [&records]() {
+        std::string s;
+        for (const AccountRecord &rec : records) s.append(rec.GetField(FT_TITLE));
+        return s;
+    };
+    ASSERT_EQ("abcd", titles());
+
+    // Move records forward and backward
+    ASSERT_EQ(id_a, records.Save({{FT_GROUP, "grp"}, {FT_TITLE, "e"}, {FT_UUID, "uuid_a"}}));
+    ASSERT_EQ("bcde", titles());
+    ASSERT_EQ(id_d, records.Save({{FT_GROUP, "grp"}, {FT_TITLE, "0"}, {FT_UUID, "uuid_d"}}));
+    ASSERT_EQ("0bce", titles());
+    // Sort key unchanged
+    ASSERT_EQ(id_b, records.Save({{FT_GROUP, "grp"}, {FT_TITLE, "b"}, {FT_USER, "user"}, {FT_UUID, "uuid_b"}}));
+    ASSERT_EQ("0bce", titles());
+
+    // Handles are stable
+    ASSERT_EQ(prec_c, &records[id_c]);
+    ASSERT_STREQ("c", records[id_c].GetField(FT_TITLE));
+    ASSERT_EQ(id_c, records.Find(FT_UUID, "uuid_c").Id());
+
+    // IDs of deleted records are reused
+    ASSERT_TRUE(records.Delete(records[id_b]));
+    ASSERT_EQ("0ce", titles());
+    ASSERT_EQ(id_b, records.Save({{FT_GROUP, "grp"}, {FT_TITLE, "d"}, {FT_UUID, "uuid_f"}}));
+    ASSERT_EQ("0cde", titles());
+}
+
+TEST(AccountRecordsTest, TestRecordFields)
+{
+    AccountRecord a{{FT_TITLE, "title"}, {FT_USER, "user"}};
+    AccountRecord b{a};
+    ASSERT_TRUE(a == b);
+    ASSERT_EQ(nullptr, a.GetField(FT_NOTES));
+    ASSERT_STREQ("none", a.GetField(FT_NOTES, "none"));
+
+    a.SetField(FT_NOTES, "notes");
+    ASSERT_STREQ("notes", a.GetField(FT_NOTES));
+    ASSERT_FALSE(a == b);
+
+    // Empty cold fields compare equal to no cold fields
+    a.SetField(FT_NOTES, "");
+    ASSERT_EQ(nullptr, a.GetField(FT_NOTES));
+    ASSERT_TRUE(a == b);
+    ASSERT_TRUE(b == a);
+}
+
+TEST(AccountRecordsTest, TestSearchText)
+{
+    auto fold = [](const char *str) {
+        std::string folded;
+        AppendFoldedText(str, folded);
+        return folded;
+    };
+    ASSERT_EQ("strasse", fold("STRASSE"));
+    ASSERT_EQ(fold("Stra\u00dfe"), fold("STRASSE"));
+    // Decomposed and precomposed forms fold to the same text
+    ASSERT_EQ(fold("CAF\u00c9"), fold("cafe\u0301"));
+
+    AccountRecord a{{FT_TITLE, "Title"}, {FT_USER, "User"}, {FT_PASSWORD, "secret"}};
+    ASSERT_TRUE(a.SearchTextContains(fold("TITLE")));
+    ASSERT_TRUE(a.SearchTextContains(fold("ser")));
+    ASSERT_FALSE(a.SearchTextContains(fold("secret")));
+    // Matches do not span fields
+    ASSERT_FALSE(a.SearchTextContains(fold("titleuser")));
+
+    // Changing a searchable field updates the search text
+    a.SetField(FT_NOTES, "Some Notes");
+    ASSERT_TRUE(a.SearchTextContains(fold("some notes")));
+    a.SetField(FT_TITLE, "Other");
+    ASSERT_FALSE(a.SearchTextContains(fold("title")));
+    ASSERT_TRUE(a.SearchTextContains(fold("other")));
+}
+
+TEST(AccountRecordsTest, TestSearchIndex)
+{
+    auto fold = [](const std::string &str) {
+        std::string folded;
+        AppendFoldedText(str.c_str(), folded);
+        return folded;
+    };
+
+    // Out of order additions and removals are merged into the postings
+    SearchIndex index;
+    std::vector<SearchIndex::RecordId> expected, ids;
+    for (SearchIndex::RecordId id = 1000; id > 0; id -= 2)
+    {
+        index.Add(id, std::string("abcd") + '\0');
+        expected.insert(expected.begin(), id);
+    }
+    for (SearchIndex::RecordId id = 4; id <= 1000; id += 4)
+    {
+        index.Remove(id, std::string("abcd") + '\0');
+        expected.erase(std::find(expected.begin(), expected.end(), id));
+    }
+    ASSERT_TRUE(index.FindCandidates("bcd", ids));
+    ASSERT_EQ(expected, ids);
+    ASSERT_TRUE(index.FindCandidates("bcde", ids));
+    ASSERT_TRUE(ids.empty());
+    ASSERT_FALSE(index.FindCandidates("bc", ids));
+
+    // Indexed search finds the same records as a scan
+    AccountRecords records;
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::string n = std::to_string(i);
+        records.Save({{FT_TITLE, "Title " + n}, {FT_USER, "user" + n}, {FT_NOTES, i % 500 == 0 ? "Rare" : ""}});
+    }
+    auto find_all = [&records](const std::string &query, bool indexed) {
+        std::vector<std::string> titles;
+        if (indexed)
+        {
+            for (size_t pos : records.FindMatches(query))
+            {
+                titles.push_back(records.begin()[pos].GetField(FT_TITLE));
+            }
+            return titles;
+        }
+        for (const AccountRecord &rec : records)
+        {
+            if (rec.SearchTextContains(query)) titles.push_back(rec.GetField(FT_TITLE));
+        }
+        return titles;
+    };
+    auto find_first = [&records](const std::string &query) {
+        return records.begin()[records.FindMatches(query).at(0)];
+    };
+    for (const char *query : {"rare", "title 1999", "user12", "itle", "zzz", "e 1"})
+    {
+        ASSERT_EQ(find_all(fold(query), false), find_all(fold(query), true)) << query;
+    }
+    ASSERT_EQ(4u, find_all(fold("RARE"), true).size());
+
+    // The index is updated when records are changed
+    AccountRecord rec = find_first(fold("user1999"));
+    rec.SetField(FT_NOTES, "rare too");
+    records.Save(rec);
+    ASSERT_EQ(5u, find_all(fold("rare"), true).size());
+    rec.SetField(FT_NOTES, "");
+    rec.SetField(FT_USER, "changed");
+    records.Save(rec);
+    ASSERT_EQ(4u, find_all(fold("rare"), true).size());
+    ASSERT_TRUE(find_all(fold("user1999"), true).empty());
+    ASSERT_EQ(1u, find_all(fold("changed"), true).size());
+    records.Delete(find_first(fold("changed")));
+    ASSERT_TRUE(find_all(fold("changed"), true).empty());
+    records.Save({{FT_TITLE, "Added"}, {FT_NOTES, "rare"}});
+    ASSERT_EQ(5u, find_all(fold("rare"), true).size());
+}
+
+TEST(AccountRecordsTest, TestIncrementalSearch)
+{
+    AccountRecords records;
+    for (int i = 0; i < 200; ++i)
+    {
+        std::string n = std::to_string(i);
+        records.Save({{FT_TITLE, "title" + n}, {FT_USER, "user"}});
+    }
+
+    IncrementalSearch search;
+    auto check = [&](const std::string &query, size_t depth) {
+        IncrementalSearch::Matches matches = search.Search(records, query);
+        ASSERT_EQ(records.FindMatches(query), matches) << query;
+        ASSERT_EQ(depth, search.results_.size()) << query;
+    };
+    // Appended characters search the previous matches
+    check("t", 1);
+    check("ti", 2);
+    check("title1", 3);
+    check("title12", 4);
+    // Deleted characters return the previous matches
+    check("title1", 3);
+    check("t", 1);
+    check("title19", 2);
+    // A query that does not extend the previous query starts over
+    check("user", 1);
+    check("x", 1);
+
+    // Changes to the records clear the matches
+    check("title5", 1);
+    records.Save({{FT_TITLE, "title5x"}});
+    check("title5x", 1);
+    ASSERT_EQ(1u, search.Search(records, "title5x").size());
+}
+
+TEST(AccountRecordsTest, TestFuzzySearch)
+{
+    auto score = [](const std::string &text, const char *query) {
+        int score = 0;
+        return FuzzySearch::Score(text, query, score) ? score : -1000;
+    };
+    ASSERT_EQ(-1000, score("github", "gx"));
+    ASSERT_EQ(-1000, score("hub", "bu"));
+    // Consecutive characters score higher than scattered characters
+    ASSERT_GT(score("github", "git"), score("gxixt", "git"));
+    // Characters at the start of a word score higher
+    ASSERT_GT(score("my bank", "bank"), score("mybank", "bank"));
+    // The shortest match ending at the first complete match is scored
+    ASSERT_EQ(score("xbank", "bank"), score("bbank", "bank"));
+    // A match spanning fields scores lower than a match in one field
+    ASSERT_LT(score(std::string("github\0me", 9), "gitme"), score("github me", "gitme"));
+    ASSERT_LT(score(std::string("git\0hub", 7), "githu"), score("git hub", "githu"));
+    // Non-ASCII characters are matched, not their bytes
+    ASSERT_GT(score("caf\u00e9", "\u00e9"), 0);
+    ASSERT_EQ(-1000, score("\u00e9", "\u00c3"));
+
+    uint64_t mask = FuzzySearch::CharMask("github");
+    ASSERT_EQ(FuzzySearch::CharMask("hub") & mask, FuzzySearch::CharMask("hub"));
+    ASSERT_NE(FuzzySearch::CharMask("x") & mask, FuzzySearch::CharMask("x"));
+
+    AccountRecords records{
+        {{FT_GROUP, "Work"}, {FT_TITLE, "GitHub"}, {FT_USER, "me"}, {FT_UUID, "uuid_a"}},
+        {{FT_GROUP, "Home"}, {FT_TITLE, "Bank"}, {FT_URL, "https://bank.example.com"}, {FT_UUID, "uuid_b"}},
+        {{FT_GROUP, "Home"}, {FT_TITLE, "Grocery Store"}, {FT_NOTES, "github"}, {FT_UUID, "uuid_c"}},
+        {{FT_GROUP, "Work"}, {FT_TITLE, "Gist"}, {FT_USER, "hub"}, {FT_UUID, "uuid_d"}},
+    };
+    FuzzySearch search;
+    auto titles = [&](const char *query) {
+        std::vector<std::string> titles;
+        for (const FuzzySearch::Match &match : search.Search(records, query))
+        {
+            titles.push_back(records.begin()[match.pos].GetField(FT_TITLE));
+        }
+        return titles;
+    };
+    // Notes are not searched, matches may span fields
+    ASSERT_EQ((std::vector<std::string>{"GitHub", "Gist"}), titles("gith"));
+    ASSERT_EQ((std::vector<std::string>{"GitHub", "Gist"}), titles("git hub"));
+    ASSERT_EQ((std::vector<std::string>{"GitHub"}), titles("git me"));
+    ASSERT_EQ((std::vector<std::string>{"GitHub", "Gist"}), titles("git"));
+    // Group and URL are searched
+    ASSERT_EQ((std::vector<std::string>{"Bank", "Grocery Store"}), titles("home"));
+    ASSERT_EQ((std::vector<std::string>{"Bank"}), titles("example"));
+    ASSERT_TRUE(titles("  ").empty());
+
+    // A match in one field ranks above a match spanning fields
+    records.Save({{FT_GROUP, "Home"}, {FT_TITLE, "Git meetup"}, {FT_UUID, "uuid_e"}});
+    ASSERT_EQ((std::vector<std::string>{"Git meetup", "GitHub"}), titles("git me"));
+}
+
+TEST(AccountRecordsTest, TestGroupRanges)
+{
+    AccountRecords records{
+        {{FT_GROUP, "grp2"}, {FT_TITLE, "a"}, {FT_UUID, "uuid_a"}},
+        {{FT_TITLE, "b"}, {FT_UUID, "uuid_b"}},
+        {{FT_GROUP, "grp1"}, {FT_TITLE, "c"}, {FT_UUID, "uuid_c"}},
+        {{FT_GROUP, "grp2"}, {FT_TITLE, "d"}, {FT_UUID, "uuid_d"}},
+    };
+    GroupNames &names = GroupNames::Instance();
+    GroupNames::Id grp1 = names.Intern("grp1").id, grp2 = names.Intern("grp2").id;
+    ASSERT_EQ(grp1, names.Intern("grp1").id);
+    ASSERT_EQ(GroupNames::NO_GROUP, names.Intern("").id);
+    ASSERT_EQ(grp2, records.Find(FT_UUID, "uuid_d")->GroupId());
+
+    auto ranges = [&records]() {
+        std::string s;
+        for (const AccountRecords::GroupRange &range : records.GroupRanges())
+        {
+            s.append(records.begin()[range.begin].GetField(FT_GROUP, "-"))
+                .append(":").append(std::to_string(range.end - range.begin)).append(" ");
+        }
+        return s;
+    };
+    ASSERT_EQ("-:1 grp1:1 grp2:2 ", ranges());
+    ASSERT_EQ(2, records.FindGroupRange(grp2)->end - records.FindGroupRange(grp2)->begin);
+
+    // Move a record to another group
+    records.Save({{FT_GROUP, "grp1"}, {FT_TITLE, "a"}, {FT_UUID, "uuid_a"}});
+    ASSERT_EQ("-:1 grp1:2 grp2:1 ", ranges());
+    // New group
+    records.Save({{FT_GROUP, "grp0"}, {FT_TITLE, "e"}, {FT_UUID, "uuid_e"}});
+    ASSERT_EQ("-:1 grp0:1 grp1:2 grp2:1 ", ranges());
+    // Last record of a group
+    ASSERT_TRUE(records.Delete(*records.Find(FT_UUID, "uuid_b")));
+    ASSERT_EQ("grp0:1 grp1:2 grp2:1 ", ranges());
+    records.Save({{FT_GROUP, "grp1"}, {FT_TITLE, "d"}, {FT_UUID, "uuid_d"}});
+    ASSERT_EQ("grp0:1 grp1:3 ", ranges());
+    ASSERT_EQ(nullptr, records.FindGroupRange(grp2));
+    ASSERT_EQ(1u, records.FindGroupRange(grp1)->begin);
+}
+
+TEST(AccountRecordsTest, TestCollation)
+{
+    AccountRecords records{
+        {{FT_TITLE, "zebra"}, {FT_UUID, "uuid_1"}},
+        {{FT_TITLE, "été"}, {FT_UUID, "uuid_2"}},
+        {{FT_TITLE, "Apple"}, {FT_UUID, "uuid_3"}},
+        {{FT_TITLE, "банк"}, {FT_UUID, "uuid_4"}},
+        {{FT_TITLE, "Альфа"}, {FT_UUID, "uuid_5"}},
+        {{FT_TITLE, "banana"}, {FT_UUID, "uuid_6"}},
+    };
+
+    // The collator is created once for the default locale, which can order
+    // scripts differently, so only the order within each script is checked
+    std::string latin, cyrillic;
+    for (const AccountRecord &rec : records)
+    {
+        const char *id = rec.GetField(FT_UUID) + 5;
+        (*id == '4' || *id == '5' ? cyrillic : latin).append(id);
+    }
+    // Case and accents don't change the order of letters
+    ASSERT_EQ("3621", latin);
+    ASSERT_EQ("54", cyrillic);
+
+    // Sort key is updated when the title changes
+    AccountRecord rec{{FT_TITLE, "a"}};
+    std::string key = rec.SortKey();
+    rec.SetField(FT_TITLE, "b");
+    ASSERT_NE(key, rec.SortKey());
+    ASSERT_LT(key, rec.SortKey());
+}
+
+TEST(AccountRecordsTest, TestDirtyTracking)
+{
+    AccountRecords records{
+        {{FT_TITLE, "a"}, {FT_UUID, "uuid_a"}},
+        {{FT_TITLE, "b"}, {FT_UUID, "uuid_b"}},
+    };
+    ASSERT_FALSE(records.IsDirty());
+
+    // Saving an unchanged record is not a change
+    records.Save({{FT_TITLE, "a"}, {FT_UUID, "uuid_a"}});
+    ASSERT_FALSE(records.IsDirty());
+    ASSERT_TRUE(records.Modified().empty());
+
+    records.Save({{FT_TITLE, "a"}, {FT_USER, "user"}, {FT_UUID, "uuid_a"}});
+    ASSERT_TRUE(records.IsDirty());
+    uint64_t seq = records.ChangeSeq();
+    ASSERT_TRUE(records.Delete(*records.Find(FT_UUID, "uuid_b")));
+    ASSERT_EQ(seq + 1, records.ChangeSeq());
+    ASSERT_EQ(2u, records.Modified().size());
+    ASSERT_EQ(seq, records.Modified().at(Uuid::FromString("uuid_a")));
+    ASSERT_EQ(seq + 1, records.Modified().at(Uuid::FromString("uuid_b")));
+
+    records.ClearDirty();
+    ASSERT_FALSE(records.IsDirty());
+    ASSERT_TRUE(records.Modified().empty());
+
+    // Setting a field to its current value does not change the record
+    AccountRecord rec{records[records.Find(FT_UUID, "uuid_a").Id()]};
+    rec.SetField(FT_USER, "user");
+    rec.SetField(FT_NOTES, "");
+    records.Save(rec);
+    ASSERT_FALSE(records.IsDirty());
+}
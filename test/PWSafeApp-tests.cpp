@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 
 #include <filesystem>
+#include <map>
 #include <string>
 #include <stdlib.h>
 
@@ -25,6 +26,46 @@ struct FilesystemMock : public Filesystem
         // Empty
     }
 
+    mutable std::vector<std::tuple<std::filesystem::path, std::filesystem::path> > link_args;
+    void CreateHardLink(const std::filesystem::path &arg1, const std::filesystem::path &arg2) const
+    {
+        link_args.push_back(std::make_tuple(arg1, arg2));
+    }
+
+    bool reflink_retval = false;
+    mutable std::vector<std::tuple<std::filesystem::path, std::filesystem::path> > reflink_args;
+    bool Reflink(const std::filesystem::path &arg1, const std::filesystem::path &arg2, std::error_code &ec) const
+    {
+        reflink_args.push_back(std::make_tuple(arg1, arg2));
+        if (!reflink_retval) ec = std::make_error_code(std::errc::operation_not_supported);
+        return reflink_retval;
+    }
+
+    std::vector<std::filesystem::path> list_directory_retval;
+    std::vector<std::filesystem::path> ListDirectory(const std::filesystem::path &/*dir*/) const
+    {
+        return list_directory_retval;
+    }
+
+    mutable std::vector<std::filesystem::path> remove_args;
+    bool Remove(const std::filesystem::path &arg, std::error_code &/*ec*/) const
+    {
+        remove_args.push_back(arg);
+        return true;
+    }
+
+    std::map<std::filesystem::path, uint64_t> hash_retval;
+    uint64_t HashFile(const std::filesystem::path &arg, std::error_code &ec) const
+    {
+        auto it = hash_retval.find(arg);
+        if (it == hash_retval.end())
+        {
+            ec = std::make_error_code(std::errc::no_such_file_or_directory);
+            return 0;
+        }
+        return it->second;
+    }
+
     bool exists_retval;
     mutable std::filesystem::path exists_arg;
     bool Exists(const std::filesystem::path &arg) const
@@ -36,7 +77,25 @@ struct FilesystemMock : public Filesystem
 
 // IMB 2023-07-02 These tests will probably fail on Windows
 
-TEST(AppTest, TestBackupDb_DstDoesntExist)
+/** Restores the preferences singleton changed by a test */
+class AppTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        saved_prefs_ = Prefs::Instance();
+    }
+
+    void TearDown() override
+    {
+        Prefs::Instance() = saved_prefs_;
+    }
+
+private:
+    Prefs saved_prefs_;
+};
+
+TEST_F(AppTest, TestBackupDb_DstDoesntExist)
 {
     setenv("TZ", "UTC0", 1);
 
@@ -54,7 +113,7 @@ TEST(AppTest, TestBackupDb_DstDoesntExist)
     ASSERT_EQ(0, strncmp(".dat", std::get<1>(fs_mock.copy_args[0]).string().c_str()+27, 4));
 }
 
-TEST(AppTest, TestBackupDb_DstDoesExist)
+TEST_F(AppTest, TestBackupDb_DstDoesExist)
 {
     setenv("TZ", "UTC0", 1);
 
@@ -70,4 +129,148 @@ TEST(AppTest, TestBackupDb_DstDoesExist)
     ASSERT_EQ(ResultCode::RC_SUCCESS, app.BackupDb());
     ASSERT_EQ(0, strncmp("/foo/pwsafe-", std::get<1>(fs_mock.copy_args[0]).string().c_str(), 7));
     ASSERT_EQ(0, strncmp(".dat", std::get<1>(fs_mock.copy_args[0]).string().c_str()+27, 4));
-}
\ No newline at end of file
+}
+
+TEST_F(AppTest, TestBackupDb_ReflinkFallsBackToCopy)
+{
+    FilesystemMock fs_mock;
+    std::string db_file("/foo/pwsafe.dat");
+
+    PWSafeApp app(fs_mock);
+    app.args_.database_ = db_file;
+    app.prefs_.Set<std::string>(Prefs::BACKUP_STRATEGY, "reflink");
+
+    fs_mock.canonical_retval = db_file;
+    fs_mock.exists_retval = false;
+
+    ASSERT_EQ(ResultCode::RC_SUCCESS, app.BackupDb());
+    ASSERT_EQ(1, fs_mock.reflink_args.size());
+    ASSERT_EQ(1, fs_mock.copy_args.size());
+    ASSERT_EQ(std::get<1>(fs_mock.reflink_args[0]), std::get<1>(fs_mock.copy_args[0]));
+
+    fs_mock.reflink_retval = true;
+    fs_mock.copy_args.clear();
+    ASSERT_EQ(ResultCode::RC_SUCCESS, app.BackupDb());
+    ASSERT_EQ(0, fs_mock.copy_args.size());
+}
+
+TEST_F(AppTest, TestBackupDb_Link)
+{
+    FilesystemMock fs_mock;
+    std::string db_file("/foo/pwsafe.dat");
+
+    PWSafeApp app(fs_mock);
+    app.args_.database_ = db_file;
+    app.prefs_.Set<std::string>(Prefs::BACKUP_STRATEGY, "link");
+
+    fs_mock.canonical_retval = db_file;
+    fs_mock.exists_retval = false;
+
+    ASSERT_EQ(ResultCode::RC_SUCCESS, app.BackupDb());
+    ASSERT_EQ(1, fs_mock.link_args.size());
+    ASSERT_EQ(db_file, std::get<0>(fs_mock.link_args[0]));
+    ASSERT_EQ(0, fs_mock.copy_args.size());
+}
+
+TEST_F(AppTest, TestCleanBackups)
+{
+    setenv("TZ", "UTC0", 1);
+    tzset();
+
+    FilesystemMock fs_mock;
+    std::string db_file("/foo/pwsafe.dat");
+
+    PWSafeApp app(fs_mock);
+    app.args_.database_ = db_file;
+    app.prefs_.Set<std::string>(Prefs::BACKUP_COUNT, "2");
+    app.prefs_.Set<std::string>(Prefs::BACKUP_KEEP_HOURLY, "0");
+    app.prefs_.Set<std::string>(Prefs::BACKUP_KEEP_DAILY, "2");
+    app.prefs_.Set<std::string>(Prefs::BACKUP_KEEP_WEEKLY, "0");
+
+    fs_mock.canonical_retval = db_file;
+    fs_mock.exists_retval = false;
+    fs_mock.list_directory_retval = {
+        "/foo/pwsafe.dat",
+        "/foo/pwsafe-20230101_100000.dat",
+        "/foo/pwsafe-20230101_110000.dat",
+        "/foo/pwsafe-20230102_100000.dat",
+        "/foo/pwsafe-20230103_100000.dat",
+        "/foo/pwsafe-20230103_110000.dat",
+        "/foo/other-20230103_110000.dat",
+        "/foo/pwsafe-2023.dat",
+    };
+
+    app.backups_.Load(db_file);
+    ASSERT_EQ(5, app.backups_.Backups().size());
+
+    app.CleanBackups();
+
+    // 2 most recent are kept, then the most recent of 2 days: 20230103_110000 and 20230102_100000
+    ASSERT_EQ(2, fs_mock.remove_args.size());
+    ASSERT_EQ("/foo/pwsafe-20230101_100000.dat", fs_mock.remove_args[0]);
+    ASSERT_EQ("/foo/pwsafe-20230101_110000.dat", fs_mock.remove_args[1]);
+    ASSERT_EQ(3, app.backups_.Backups().size());
+
+    // Days are local calendar days: 20230102_200000 EST is on 2023-01-03 UTC,
+    // the same day as 20230103_100000
+    setenv("TZ", "EST5", 1);
+    tzset();
+    app.prefs_.Set<std::string>(Prefs::BACKUP_COUNT, "1");
+    fs_mock.remove_args.clear();
+    fs_mock.list_directory_retval = {
+        "/foo/pwsafe-20230102_100000.dat",
+        "/foo/pwsafe-20230102_200000.dat",
+        "/foo/pwsafe-20230103_100000.dat",
+    };
+    PWSafeApp app_est(fs_mock);
+    app_est.args_.database_ = db_file;
+    app_est.backups_.Load(db_file);
+
+    app_est.CleanBackups();
+
+    ASSERT_EQ(1, fs_mock.remove_args.size());
+    ASSERT_EQ("/foo/pwsafe-20230102_100000.dat", fs_mock.remove_args[0]);
+    setenv("TZ", "UTC0", 1);
+    tzset();
+}
+
+TEST_F(AppTest, TestBackupPathname)
+{
+    setenv("TZ", "UTC0", 1);
+    tzset();
+
+    std::filesystem::path backup = BackupCatalog::BackupPathname("/foo/pwsafe.dat", 1672567200);
+    ASSERT_EQ("/foo/pwsafe-20230101_100000.dat", backup);
+
+    time_t time;
+    ASSERT_TRUE(BackupCatalog::ParseBackupPathname("/foo/pwsafe.dat", backup, time));
+    ASSERT_EQ(1672567200, time);
+    ASSERT_FALSE(BackupCatalog::ParseBackupPathname("/foo/pwsafe.dat", "/foo/pwsafe.dat", time));
+    ASSERT_FALSE(BackupCatalog::ParseBackupPathname("/foo/pwsafe.dat", "/foo/pwsafe-20230101_1000000.dat", time));
+}
+
+TEST_F(AppTest, TestBackupDb_SkipsUnchanged)
+{
+    FilesystemMock fs_mock;
+    std::string db_file("/foo/pwsafe.dat");
+
+    PWSafeApp app(fs_mock);
+    app.args_.database_ = db_file;
+
+    fs_mock.canonical_retval = db_file;
+    fs_mock.exists_retval = false;
+    fs_mock.hash_retval[db_file] = 1;
+
+    ASSERT_EQ(ResultCode::RC_SUCCESS, app.BackupDb());
+    ASSERT_EQ(1, fs_mock.copy_args.size());
+
+    // Backup exists and database is unchanged
+    fs_mock.exists_retval = true;
+    ASSERT_EQ(ResultCode::RC_SUCCESS, app.BackupDb());
+    ASSERT_EQ(1, fs_mock.copy_args.size());
+
+    // Database changed
+    fs_mock.hash_retval[db_file] = 2;
+    ASSERT_EQ(ResultCode::RC_SUCCESS, app.BackupDb());
+    ASSERT_EQ(2, fs_mock.copy_args.size());
+}